@@ -0,0 +1,361 @@
+/*
+    SDL - Simple DirectMedia Layer
+    Copyright (C) 1997, 1998, 1999, 2000, 2001, 2002  Sam Lantinga
+    Copyright (C) 2003  J. Grant  (PS2Linux joystick code and actuator support)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    Sam Lantinga
+    slouken@libsdl.org
+
+    J. Grant
+    jg-sdl@jguk.org
+*/
+
+/* Extensions to the SDL joystick API provided by the PS2Linux joystick
+   module.  These functions only exist when SDL is built with it. */
+
+#ifndef _SDL_ps2pad_h
+#define _SDL_ps2pad_h
+
+#include "SDL_types.h"
+#include "SDL_joystick.h"
+#include "SDL_audio.h"
+
+#include "begin_code.h"
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One actuator setting, for SDL_JoystickSetActuators() */
+typedef struct SDL_JoystickActuatorLevel {
+	SDL_Joystick *joystick;
+	int actuator;		/* Actuator index, starting at 0 */
+	int frequency;		/* 0-65535, as for SDL_JoystickSetActuator() */
+} SDL_JoystickActuatorLevel;
+
+/*
+ * Set several actuators, on one or more joysticks, together.
+ * Each joystick is sent at most one update, and none at all if its
+ * actuators end up where they already were.  Nothing is changed if any
+ * entry is invalid.
+ * Return value of 1 indicates an error
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickSetActuators(const SDL_JoystickActuatorLevel *levels, int numlevels);
+
+/* Input history
+ *
+ * The last 128 decoded reports of each open joystick are kept, stamped with
+ * SDL_GetTicks() when they were read.  The history is filled as joysticks
+ * are updated, so it should only be read from the thread that updates them
+ * (the one calling SDL_PollEvent() or SDL_JoystickUpdate()).  Only the first
+ * 8 axes and 32 buttons are recorded.
+ */
+#define SDL_JOYHISTORY_NEAREST	0	/* The value of the closest report */
+#define SDL_JOYHISTORY_LINEAR	1	/* Interpolated between two reports */
+
+typedef struct SDL_JoyButtonTransition {
+	Uint32 timestamp;	/* SDL_GetTicks() of the report with the change */
+	Uint8 button;
+	Uint8 state;		/* SDL_PRESSED or SDL_RELEASED */
+} SDL_JoyButtonTransition;
+
+/*
+ * Get the state of an axis control on a joystick at a time in the recent
+ * past.  After the newest report the last value is returned.
+ * Returns 0, or -1 if the time is older than the history.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickGetAxisAt(SDL_Joystick *joystick, int axis, Uint32 ticks, int interpolation, Sint16 *value);
+
+/*
+ * Get the button presses and releases of a joystick in the time window
+ * start <= t < end, oldest first.  At most maxtransitions are stored.
+ * Returns the number stored, or -1 on error.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickGetButtonTransitions(SDL_Joystick *joystick, Uint32 start, Uint32 end, SDL_JoyButtonTransition *transitions, int maxtransitions);
+
+/* Sampling skew
+ *
+ * The pads are read one after another, so players on different ports are
+ * sampled at slightly different times.  With SDL_JOYSTICK_GROUP_SAMPLING=1
+ * set at init, the first pad updated in a round reads every open pad back
+ * to back, and all of them get the same timestamp.  The skew is measured
+ * in either mode.
+ */
+typedef struct SDL_JoystickSamplingStats {
+	Uint32 rounds;		/* Rounds in which more than one pad was read */
+	Uint32 last_skew;	/* Microseconds from the first to the last read */
+	Uint32 max_skew;
+	Uint32 overruns;	/* Pads left out of a group round while busy */
+} SDL_JoystickSamplingStats;
+
+extern DECLSPEC void SDLCALL SDL_JoystickGetSamplingStats(SDL_JoystickSamplingStats *stats);
+
+/* Frame events
+ *
+ * Instead of one event per axis, hat and button, a joystick can post a
+ * single event for each report it reads, carrying everything that changed.
+ * The event is a user event of the type chosen with
+ * SDL_JoystickFrameEventState(); event.user.code is the joystick index and
+ * event.user.data1 points to an SDL_JoyFrameEvent.  That frame stays valid
+ * while the event is queued, and until 128 more frames have been posted for
+ * the same joystick, so handle it when it is polled.
+ *
+ * The per-control events are still posted unless they are turned off with
+ * SDL_EventState(), e.g. SDL_EventState(SDL_JOYAXISMOTION, SDL_IGNORE);
+ * the joystick state read by SDL_JoystickGetAxis() etc. is kept either way.
+ */
+typedef struct SDL_JoyFrameEvent {
+	Uint8 which;		/* The joystick device index */
+	Uint8 hat;		/* Hat 0 position, SDL_HAT_* */
+	Uint8 hat_changed;
+	Uint8 changed_axes;	/* Bit set for each axis that moved */
+	Uint32 changed_buttons;	/* Bit set for each button that changed */
+	Uint32 buttons;		/* Bit set for each button held down */
+	Uint32 timestamp;	/* SDL_GetTicks() when the report was read */
+	Sint16 axes[8];		/* The value of every axis after the report */
+} SDL_JoyFrameEvent;
+
+/*
+ * Choose the user event type (SDL_USEREVENT to SDL_NUMEVENTS-1) used for
+ * frame events, or 0 to stop posting them.  SDL_QUERY leaves it as it is.
+ * Returns the previous type, 0 if they were off, or -1 on error.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickFrameEventState(int type);
+
+/* Frame callbacks
+ *
+ * For code that must react within the report that caused a change (audio,
+ * haptics), a function can be called with each frame of a joystick straight
+ * from the backend, before anything reaches the event queue.
+ *
+ * Threading rules: the callback runs on whichever thread updates the
+ * joysticks, i.e. the one in SDL_PumpEvents()/SDL_JoystickUpdate(), or the
+ * SDL event thread when SDL_INIT_EVENTTHREAD is used.  The frame is only
+ * valid during the call.  The callback must return quickly, and must not
+ * update, open or close joysticks or pump events.  Set or clear it from the
+ * thread that updates the joysticks, or while no update can be running.
+ */
+typedef void (SDLCALL *SDL_JoystickFrameCallback)(const SDL_JoyFrameEvent *frame, void *userdata);
+
+/*
+ * Set the function called with every frame of a joystick that changes
+ * something, or NULL to stop calling it.  Returns 0, or -1 on error.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickSetFrameCallback(SDL_Joystick *joystick, SDL_JoystickFrameCallback callback, void *userdata);
+
+/* Sharing pads between processes
+ *
+ * With SDL_JOYSTICK_SHM_PUBLISH=<name> set at init, the joysticks this
+ * process opens are published in the POSIX shared memory object <name>
+ * (e.g. "/sdl-joystick").  Another process started with
+ * SDL_JOYSTICK_SHM=<name> sees them as its own joysticks, through the same
+ * API, without touching the devices.  Such joysticks have no actuators,
+ * and are only updated while the publisher keeps updating its joysticks.
+ */
+
+/* Streaming pads
+ *
+ * The joysticks can also be sent to another process, or recorded, as a
+ * stream of compact records holding only what changed in each frame.
+ * SDL_JOYSTICK_STREAM_EXPORT=<where> set at init starts sending, where
+ * <where> is fd:<n> for a descriptor that is already open, or the path of a
+ * Unix domain socket to connect to.  A process started with
+ * SDL_JOYSTICK_STREAM=<where> listens on that socket (or reads that
+ * descriptor) and plays the stream back as its own joysticks, without
+ * touching the devices.  Axes are sent with 8 bits of precision.
+ *
+ * The records of all the joysticks are written together, once every
+ * joystick has been updated.  The descriptor is made non-blocking: if the
+ * reader falls too far behind, records are dropped and the state is sent
+ * again whole.
+ */
+typedef struct SDL_JoystickStreamStats {
+	Uint32 frames;		/* Frames sent, or played back */
+	Uint32 bytes;		/* Bytes written, or read */
+	Uint32 calls;		/* System calls that wrote or read them */
+	Uint32 dropped;		/* Times the reader fell too far behind */
+} SDL_JoystickStreamStats;
+
+/*
+ * Start sending the joysticks to a file descriptor, or stop with -1.
+ * The descriptor is not closed by SDL.
+ * Returns 0, or -1 if the joysticks are being read from a stream or
+ * the descriptor isn't open.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickExportStream(int fd);
+
+extern DECLSPEC void SDLCALL SDL_JoystickGetStreamStats(SDL_JoystickStreamStats *stats);
+
+/* Session analytics
+ *
+ * Each open joystick keeps running totals of how it has been used, added
+ * to as its reports are decoded: button presses and how long each was
+ * held, where the sticks spent their time, and how often the actuators
+ * were run.  The totals are fixed size and start from zero when the
+ * joystick is opened.  A button hold is counted when it is released.
+ */
+#define SDL_JOYSTATS_BUTTONS		32
+#define SDL_JOYSTATS_HOLD_BUCKETS	12	/* < 32 ms, < 64 ms ... < 32 s, longer */
+#define SDL_JOYSTATS_STICKS		2	/* Axes 0 and 1, axes 2 and 3 */
+#define SDL_JOYSTATS_GRID		16	/* Cells across each stick */
+#define SDL_JOYSTATS_ACTUATORS		2
+
+typedef struct SDL_JoystickAnalytics {
+	Uint32 session_ms;	/* Time from the first report to the last */
+	Uint32 presses[SDL_JOYSTATS_BUTTONS];
+	Uint32 hold_ms[SDL_JOYSTATS_BUTTONS];	/* Total time held */
+	Uint32 holds[SDL_JOYSTATS_BUTTONS][SDL_JOYSTATS_HOLD_BUCKETS];
+	/* Milliseconds each stick spent in each cell, [y][x], top left first */
+	Uint32 stick_ms[SDL_JOYSTATS_STICKS][SDL_JOYSTATS_GRID][SDL_JOYSTATS_GRID];
+	Uint32 actuator_activations[SDL_JOYSTATS_ACTUATORS];	/* Times started */
+	Uint32 actuator_changes[SDL_JOYSTATS_ACTUATORS];	/* Level changes */
+	Uint32 actuator_ms[SDL_JOYSTATS_ACTUATORS];		/* Time running */
+} SDL_JoystickAnalytics;
+
+/*
+ * Copy the totals of a joystick into analytics (if not NULL), and set them
+ * back to zero if reset is non-zero.  Returns 0, or -1 on error.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickGetAnalytics(SDL_Joystick *joystick, SDL_JoystickAnalytics *analytics, int reset);
+
+/* Axis jitter filter
+ *
+ * Analog sticks wobble by a step or two at rest, which makes a steady
+ * stream of SDL_JOYAXISMOTION events.  The filter smooths each of the first
+ * 8 axes with a low pass whose cutoff rises with the speed of the stick
+ * (a "1 Euro" filter), so a stick at rest is steadied and a moving one is
+ * hardly delayed.  A new position is only sent when it has moved by the
+ * hysteresis, or has caught up with the stick.
+ *
+ * SDL_JOYSTICK_AXIS_FILTER="<min cutoff> [<beta> [<hysteresis>]]" set at
+ * init puts the filter on every joystick as it is opened, e.g. "1" for a
+ * 1 Hz cutoff at rest and the default beta and hysteresis.
+ */
+typedef struct SDL_JoystickAxisFilter {
+	float min_cutoff;	/* Hz, cutoff of a stick at rest (1.0) */
+	float beta;		/* Cutoff added per full axis a second (16.0) */
+	int hysteresis;		/* Smallest step sent, in axis units (512) */
+} SDL_JoystickAxisFilter;
+
+typedef struct SDL_JoystickAxisFilterStats {
+	Uint32 changes;		/* Positions read that differ from the last */
+	Uint32 delivered;	/* Positions sent out */
+	Uint32 suppressed;	/* changes that were not sent */
+} SDL_JoystickAxisFilterStats;
+
+/*
+ * Put the filter on a joystick's axes, or take it off with NULL.
+ * The filter can't be put on a joystick from another process.
+ * Returns 0, or -1 on error.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickSetAxisFilter(SDL_Joystick *joystick, const SDL_JoystickAxisFilter *filter);
+
+/*
+ * Get the counts of axis changes the filter has read and sent, since the
+ * joystick was opened.  Returns 0, or -1 on error.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickGetAxisFilterStats(SDL_Joystick *joystick, SDL_JoystickAxisFilterStats *stats);
+
+/* Audio driven haptics
+ *
+ * The actuators of a joystick can follow the game's audio.  The audio
+ * callback passes each buffer it fills to SDL_JoystickFeedAudio(), which
+ * keeps the band between low_hz and high_hz (the thump of explosions and
+ * engines), follows its loudness, and works out the actuator levels from
+ * it.  This is cheap, and neither allocates nor blocks, so it is safe in
+ * the callback.  The levels are sent to the pad by SDL_JoystickUpdate(),
+ * no more often than every interval_ms.
+ *
+ * The envelope is from 0 to 32767.  An actuator with a range, the big
+ * motor, starts at threshold and rises by gain/128 per step of envelope
+ * above it.  An on/off actuator, the small motor, is on from
+ * small_threshold, and stays on until the envelope falls to half of it.
+ * Only AUDIO_S16SYS, AUDIO_U8 and AUDIO_S8 audio is used.
+ */
+typedef struct SDL_JoystickAudioHaptics {
+	int low_hz;		/* Lowest frequency felt (20) */
+	int high_hz;		/* Highest frequency felt (150) */
+	int threshold;		/* Envelope where the big motor starts (1024), 0-32767 */
+	int small_threshold;	/* Envelope where the small motor is on (12000), 0-32767 */
+	int gain;		/* 256 reaches full level 32767 above threshold, 0-4096 */
+	int interval_ms;	/* Least time between updates to the pad (16) */
+} SDL_JoystickAudioHaptics;
+
+/*
+ * Drive a joystick's actuators from the audio, or stop with NULL, which
+ * also turns the actuators off.  Returns 0, or -1 on error.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickSetAudioHaptics(SDL_Joystick *joystick, const SDL_JoystickAudioHaptics *haptics);
+
+/*
+ * Give a buffer of audio to every joystick the audio is driving.  Call
+ * this from the audio callback, with the spec the audio was opened with.
+ */
+extern DECLSPEC void SDLCALL SDL_JoystickFeedAudio(const SDL_AudioSpec *spec, const Uint8 *stream, int len);
+
+/* Light guns
+ *
+ * The Namco G-Con 45 is opened as a joystick with two axes, where it
+ * points across and down the screen, from -32768 at the left and top to
+ * 32767 at the right and bottom.  Buttons 0-2 are the trigger, A and B,
+ * and button 3 is pressed while it points off the screen.  The axes keep
+ * the last position on the screen.
+ *
+ * The gun only sees the picture once a video frame, so call
+ * SDL_JoystickGunFrame() once a frame, just after the display is flipped,
+ * to read every gun then.  SDL_JoystickUpdate() sends the events.  While
+ * it isn't called, the guns are read SDL_JOYSTICK_GUN_HZ (60) times a
+ * second.  SDL_JOYSTICK_GUN_AREA="<left> <right> <top> <bottom>" sets the
+ * raw positions at the edges of the picture, "77 461 25 248" for NTSC.
+ *
+ * Threading rules: SDL_JoystickGunFrame() leaves the reports where the
+ * next joystick update picks them up, and SDL_JoystickGetGunSample() reads
+ * what the updates last stored, so call both from the thread that updates
+ * the joysticks, i.e. the one in SDL_PumpEvents()/SDL_JoystickUpdate(), or
+ * while no update can be running.  With SDL_INIT_EVENTTHREAD the updates
+ * run on the SDL event thread, so leave SDL_JoystickGunFrame() uncalled and
+ * let the guns be read at SDL_JOYSTICK_GUN_HZ.
+ */
+typedef struct SDL_JoystickGunSample {
+	Uint32 frame;		/* SDL_JoystickGunFrame() calls when read */
+	Uint32 timestamp;	/* SDL_GetTicks() when read */
+	Uint32 timestamp_us;	/* Microseconds, for the time between reads */
+	Uint16 x;		/* Raw position, 8 MHz clocks into the line */
+	Uint16 y;		/* Raw position, lines down the field */
+	Sint16 axis[2];		/* The axes, as sent in events */
+	Uint16 buttons;		/* Bit set for each button pressed */
+	Uint8 onscreen;
+} SDL_JoystickGunSample;
+
+/*
+ * Read every light gun now, as a new video frame is shown.
+ */
+extern DECLSPEC void SDLCALL SDL_JoystickGunFrame(void);
+
+/*
+ * Get the last position read from a light gun.  Returns 0, or -1 if the
+ * joystick is not a light gun.
+ */
+extern DECLSPEC int SDLCALL SDL_JoystickGetGunSample(SDL_Joystick *joystick, SDL_JoystickGunSample *sample);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+#include "close_code.h"
+
+#endif /* _SDL_ps2pad_h */
@@ -35,10 +35,15 @@ static char rcsid =
 #include <stdio.h>		/* For the definition of NULL */
 #include <stdlib.h>		/* For getenv() prototype */
 #include <string.h>
+#include <errno.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <limits.h>		/* For the definition of PATH_MAX */
 #ifdef __arm__
 #include <linux/limits.h> /* Arm cross-compiler needs this */
@@ -51,18 +56,115 @@ static char rcsid =
 #include <linux/ps2/pad.h>	/* PS2Linux controller defines */
 
 #include "SDL_error.h"
+#include "SDL_thread.h"
+#include "SDL_timer.h"
+#include "SDL_events.h"
 #include "SDL_joystick.h"
 #include "SDL_sysjoystick.h"
 #include "SDL_joystick_c.h"
+#include "SDL_ps2pad.h"
 
 /* The maximum number of joysticks we'll detect */
 #define MAX_JOYSTICKS	2
 #define NUM_BUTTONS 12
+#define NUM_AXES 4
+#define MAX_ACTUATORS 2
+
+/* The input history kept for each joystick, see SDL_JoystickGetAxisAt() */
+#define HISTORY_FRAMES	128	/* Must be a power of two */
+#define HISTORY_AXES	8
+#define HISTORY_BUTTONS	32
+
+/* The axes that can go through the jitter filter, see FilterAxis(),
+   and its default settings */
+#define FILTER_AXES	8
+#define JOYFILTER_MIN_CUTOFF	1.0f	/* Hz */
+#define JOYFILTER_BETA		16.0f
+#define JOYFILTER_HYSTERESIS	512	/* Two steps of the 8 bit PS2 axes */
+
+/* The Namco G-Con 45 light gun, see JS_DecodeGun().  Its position is in
+   8 MHz clocks from the start of the line and in lines from the top of
+   the field, and these are the edges of an NTSC picture. */
+#ifndef PS2PAD_TYPE_NAMCOGUN
+#define PS2PAD_TYPE_NAMCOGUN	6
+#endif
+#define NUM_GUN_BUTTONS	3
+#define JOYGUN_LEFT	77
+#define JOYGUN_RIGHT	461
+#define JOYGUN_TOP	25
+#define JOYGUN_BOTTOM	248
+#define JOYGUN_HZ	60	/* Reads a second without SDL_JoystickGunFrame() */
+
+/* The maximum number of device nodes considered at init, and the number
+   of them probed concurrently */
+#define MAX_PROBE_NODES	32
+#define MAX_PROBE_THREADS	8
+
+/* What a device node turned out to be when it was probed */
+#define JOYKIND_NONE	0	/* Not a joystick */
+#define JOYKIND_PS2PAD	1	/* PS2Linux ps2pad.o node */
+#define JOYKIND_EVDEV	2	/* Linux 2.4 unified input event node */
+#define JOYKIND_SHM	3	/* Published by another process, see SHM_Publish() */
+#define JOYKIND_STREAM	4	/* Played back from a stream, see STREAM_Read() */
+#define JOYKIND_ANY	-1	/* User specified, take whatever it is */
+
+/* The names of the pad types, as reported by SDL_SYS_JoystickName() */
+static const struct ps2pad_name {
+	int type;
+	const char *name;
+} ps2pad_names[] = {
+	{ PS2PAD_TYPE_NEJICON,	"Nejicon" },
+	{ PS2PAD_TYPE_DIGITAL,	"Digital" },
+	{ PS2PAD_TYPE_ANALOG,	"Analog" },
+	{ PS2PAD_TYPE_NAMCOGUN,	"G-Con 45" },
+	{ PS2PAD_TYPE_DUALSHOCK,	"DualShock 1/2" }
+};
+
+/* Mapping is the same as in Linux Joystick code.  With the exception of L3 and R3
+because these are new numbers (Linux JS code did not support before).  Definition 
+of these 12 PS2 Direction Pad control buttons is used in the xor comparison */
+static const Uint32 ps2pad_buttons[NUM_BUTTONS] = {
+		PS2PAD_BUTTON_SQUARE,
+		PS2PAD_BUTTON_CROSS,
+		PS2PAD_BUTTON_TRIANGLE,	/* The same as PS2PAD_BUTTON_B */
+		PS2PAD_BUTTON_CIRCLE,	/* The same as PS2PAD_BUTTON_A */
+		PS2PAD_BUTTON_L1,
+		PS2PAD_BUTTON_R1,	/* The same as PS2PAD_BUTTON_R */
+		PS2PAD_BUTTON_L2,
+		PS2PAD_BUTTON_R2,
+		PS2PAD_BUTTON_SELECT,
+		PS2PAD_BUTTON_START,
+		PS2PAD_BUTTON_L3,
+		PS2PAD_BUTTON_R3 };
+
+/* The G-Con 45 buttons: trigger, A (left side) and B (right side) */
+static const Uint32 ps2pad_gun_buttons[NUM_GUN_BUTTONS] = {
+		PS2PAD_BUTTON_CIRCLE,
+		PS2PAD_BUTTON_START,
+		PS2PAD_BUTTON_CROSS };
+
+/* Offsets of the analog stick bytes in the pad data, in the same order as
+   the Linux JS module. (left == 0,1, right == 2,3) */
+static const int ps2pad_axes[NUM_AXES] = { 6, 7, 4, 5 };
+
+/* The DualShock 1/2 actuators, in the order of the PS2PAD_IOCSETACT data */
+static const struct ps2pad_actuator {
+	unsigned int range;
+	unsigned int type;
+} ps2pad_actuators[MAX_ACTUATORS] = {
+	{ 1, 0 },	/* small, boolean */
+	{ 255, 1 }	/* big, 0-255 */
+};
 
 /* A list of available joysticks */
-static char *SDL_joylist[MAX_JOYSTICKS];
+static struct joylist_item {
+	char *path;
+	dev_t rdev;		/* major/minor device numbers */
+	int kind;		/* JOYKIND_* */
+	int port;		/* PS2 port number, index into /dev/ps2padstat */
+} SDL_joylist[MAX_JOYSTICKS];
 
-static int ps2padstat_fd;	/* PS2 pad status fd for /dev/ps2padstat */
+static int ps2padstat_fd = -1;	/* PS2 pad status fd for /dev/ps2padstat, opened on first use */
 
 static int current_axis = -1;	/* Contains the axis number current being sent as SDL_JOYAXISMOTION */
 
@@ -71,9 +173,87 @@ struct joystick_hwdata {
 	int fd;
 	int joystick_type;		/* Required to know supported features */
 	
+	/* The most recent decoded frames, oldest overwritten first */
+	struct joyframe {
+		Uint32 timestamp;		/* SDL_GetTicks() when read */
+		Uint32 buttons;			/* Bit set for each pressed button */
+		Sint16 axes[HISTORY_AXES];
+		Uint8 hat;
+	} history[HISTORY_FRAMES];
+	unsigned int history_count;	/* Frames recorded since open */
+
+	/* Actuator levels follow the audio, see SDL_JoystickFeedAudio().
+	   The level is written by the audio thread, and read at update. */
+	SDL_bool haptics_on;
+	SDL_JoystickAudioHaptics haptics;
+	int haptics_rate;		/* The sample rate haptics_coef is for */
+	int haptics_coef[4];		/* Q12 band low pass, band high pass,
+					   envelope attack and release */
+	int haptics_state[3];		/* The two low passes, and the envelope */
+	volatile int haptics_level[MAX_ACTUATORS];
+	Uint32 haptics_time;		/* When the levels were last sent */
+
+	/* Running totals since open, see CountFrame(), and what they need to
+	   remember between frames */
+	SDL_JoystickAnalytics analytics;
+	Uint32 press_time[HISTORY_BUTTONS];	/* When each held button went down */
+	Uint32 actuator_on_time[SDL_JOYSTATS_ACTUATORS];
+
+	/* Called with every frame that changes something, see DeliverFrame() */
+	SDL_JoystickFrameCallback frame_callback;
+	void *frame_userdata;
+
+	/* The last frame applied when fed by another process, see
+	   ApplyRemoteFrame(), and how far the shared memory ring was read */
+	struct joyframe remote_state;
+	Uint32 shm_frame_count;
+	Uint32 shm_clock_offset;	/* Owner's SDL_GetTicks() to ours */
+
+	/* A report read ahead by JS_SampleGroup(), waiting to be decoded */
+	SDL_bool sampled;
+	int sample_stat;
+	Uint32 sample_time;
+	Uint8 sample_buffer[PS2PAD_DATASIZE];
+
+	/* Decodes a pad data report, chosen for the pad type at open */
+	void (*decode)(SDL_Joystick *joystick, const Uint8 *joystick_buffer);
+
+	/* The jitter filter, see FilterAxis().  While it is on, decode is
+	   JS_DecodeFiltered and decode_unfiltered is the routine it replaced. */
+	SDL_bool filter_on;
+	SDL_JoystickAxisFilter filter_params;
+	struct axis_filter {
+		float value;		/* Filtered position, -1 to 1 */
+		float speed;		/* Filtered rate of change, per second */
+		int raw;		/* The last position read */
+		int delivered;		/* The last position sent out */
+		Uint32 time;		/* SDL_GetTicks() of the last position read */
+		SDL_bool primed;
+	} filter[FILTER_AXES];
+	Uint8 filter_unsettled;		/* Bit set for each axis still catching up */
+	Uint32 report_time;		/* SDL_GetTicks() of the report being decoded */
+	SDL_JoystickAxisFilterStats filter_stats;
+	void (*decode_unfiltered)(SDL_Joystick *joystick, const Uint8 *joystick_buffer);
+
+	/* A light gun, see JS_DecodeGun().  sample_buffer holds its report
+	   from SDL_JoystickGunFrame() until it is decoded. */
+	SDL_bool gun;
+	SDL_JoystickGunSample gun_sample;	/* The last position read */
+	Uint32 gun_frame;		/* SDL_joygun.frame of sample_buffer */
+	Uint32 gun_time_us;		/* JS_Microseconds() of sample_buffer */
+
 	/* Required to calculate what has changed and thus SDL_RELEASE joystick events */
 	Uint8 old_joystick_buffer[PS2PAD_DATASIZE];
 	Uint32 old_joystick_buttons;
+
+	/* The controller mapping in use, see SDL_joymap */
+	Uint32 button_mask[NUM_BUTTONS];	/* PS2PAD_BUTTON_* for each button */
+	int axis_offset[NUM_AXES];		/* Pad data offset for each axis */
+	Uint8 axis_invert;			/* Bit set for each inverted axis */
+	int actuator_map[MAX_ACTUATORS];	/* PS2PAD_IOCSETACT byte for each actuator */
+
+	/* An actuator's normalised value changed since it was last sent */
+	SDL_bool actuators_dirty;
 	/* The current linux joystick driver maps hats to two axes */
 	struct hwdata_hat {
 		int axis[2];
@@ -92,9 +272,86 @@ struct joystick_hwdata {
 		int used;
 		int coef[3];
 	} abs_correct[ABS_MAX];
+
+	/* Force feedback actuators.  One effect drives every motor; it is
+	   uploaded again only when its levels change, and is started and
+	   stopped with EV_FF writes. */
+	int ff_type;			/* FF_RUMBLE, FF_PERIODIC, or 0 if none */
+	struct ff_effect ff_effect;	/* As uploaded, id is -1 until then */
+	SDL_bool ff_playing;
 #endif
 };
 
+/* The open joysticks, by index, for sampling every pad at once */
+static SDL_Joystick *SDL_joyopen[MAX_JOYSTICKS];
+
+/* Read all the pads together on the first update of each round */
+static SDL_bool SDL_joygroup = SDL_FALSE;
+#define GROUP_WINDOW_US	2000	/* Longest wait for one pad in a round */
+
+/* The jitter filter put on every joystick at open, from
+   SDL_JOYSTICK_AXIS_FILTER="<min cutoff> [<beta> [<hysteresis>]]" */
+static SDL_bool SDL_joyfilter = SDL_FALSE;
+static SDL_JoystickAxisFilter SDL_joyfilter_params;
+
+/* Light guns are read once a video frame, see SDL_JoystickGunFrame() */
+static struct {
+	int area[4];		/* Left, right, top and bottom edges */
+	Uint32 period_us;	/* Time between reads when not told of frames */
+	Uint32 frame;		/* Calls to SDL_JoystickGunFrame() */
+	Uint32 frame_us;	/* JS_Microseconds() of the last call */
+} SDL_joygun;
+
+/* The time between reading the first and the last pad in a round */
+static struct {
+	Uint32 round_ports;	/* Bit set for each port read this round */
+	Uint32 round_start;
+	Uint32 round_end;
+	SDL_JoystickSamplingStats stats;
+} SDL_joysampling;
+
+/* Frame events, one per report carrying everything that changed in it.
+   The events point into this ring, so a frame stays valid until
+   FRAME_EVENTS more have been posted for the same joystick.  That is as
+   many as the SDL event queue holds (MAXEVENTS in SDL_events.c), so a
+   frame can't be written over while its event is still queued, even by
+   the event thread. */
+#define FRAME_EVENTS	128	/* Must be a power of two */
+static int SDL_joyframe_type = 0;	/* Event type, or 0 when disabled */
+static SDL_JoyFrameEvent SDL_joyframes[MAX_JOYSTICKS][FRAME_EVENTS];
+static unsigned int SDL_joyframe_count[MAX_JOYSTICKS];
+
+/* A device node waiting to be probed by SDL_SYS_JoystickInit() */
+struct joyprobe {
+	char *path;
+	struct stat sb;
+	int kind;		/* JOYKIND_* expected before probing, found after */
+	SDL_bool cacheable;	/* The probe came to a definite verdict */
+
+	/* What an event device says it is, see EV_Identify() */
+	SDL_bool identified;
+	Uint16 id[4];		/* Bus type, vendor, product and version */
+	Uint32 name_hash;
+};
+
+/* The persistent capability cache.  An event device probed by an earlier
+   run is recognised by its device number together with the identity it
+   reports (EVIOCGID and a hash of EVIOCGNAME), so a different device
+   plugged in at the same minor is probed afresh.  Only the capability
+   checks are saved: every node is still opened, and a PS2 pad node is
+   never cached, since opening it is the whole probe.
+ */
+#define JOYCACHE_MAGIC	"SDL_JOYCACHE 2"
+
+static struct joycache_entry {
+	dev_t rdev;
+	Uint16 id[4];
+	Uint32 name_hash;
+	int kind;		/* JOYKIND_EVDEV or JOYKIND_NONE */
+} *SDL_joycache = NULL;
+static int SDL_joycache_len = 0;
+static SDL_bool SDL_joycache_dirty = SDL_FALSE;
+
 static char *mystrdup(const char *string)
 {
 	char *newstring;
@@ -127,876 +384,3918 @@ static int EV_IsJoystick(int fd)
 	return(1);
 }
 
+/* Read the identity of an event device into probe, for the cache */
+static int EV_Identify(int fd, struct joyprobe *probe)
+{
+	unsigned short id[4];
+	char name[128];
+	Uint32 hash;
+	int i;
+
+	if ( ioctl(fd, EVIOCGID, id) < 0 ) {
+		return(0);
+	}
+	if ( ioctl(fd, EVIOCGNAME(sizeof(name)), name) < 0 ) {
+		name[0] = '\0';
+	}
+	name[sizeof(name)-1] = '\0';
+
+	/* FNV-1a */
+	hash = 2166136261u;
+	for ( i=0; name[i]; ++i ) {
+		hash = (hash ^ (Uint8)name[i]) * 16777619u;
+	}
+	for ( i=0; i<4; ++i ) {
+		probe->id[i] = id[i];
+	}
+	probe->name_hash = hash;
+	probe->identified = SDL_TRUE;
+	return(1);
+}
+
 #endif /* USE_INPUT_EVENTS */
 
-/* Function to scan the system for joysticks */
-int SDL_SYS_JoystickInit(void)
+/* Return the file the capability cache is kept in, or NULL if disabled.
+   The cache is only kept when SDL_JOYSTICK_CACHE names a file for it. */
+static const char *JoyCachePath(char *path, int maxlen)
 {
-	/* The base path of the joystick devices */
-	const char *joydev_devices[] = {
-#ifdef USE_INPUT_EVENTS
-		"/dev/input/event%d",
-#endif
-		"/dev/ps2pad00",
-		"/dev/ps2pad10"
-	};
-	int numjoysticks;
-	int j;
-	int fd;
-	char path[PATH_MAX];
-	dev_t dev_nums[MAX_JOYSTICKS];  /* major/minor device numbers */
-	struct stat sb;
-	int n, duplicate;
+	const char *env;
 
-	numjoysticks = 0;
+	env = getenv("SDL_JOYSTICK_CACHE");
+	if ( (env == NULL) || (*env == '\0') ) {
+		return(NULL);
+	}
+	strncpy(path, env, maxlen-1);
+	path[maxlen-1] = '\0';
+	return(path);
+}
 
-	/* First see if the user specified a joystick to use */
-	if ( getenv("SDL_JOYSTICK_DEVICE") != NULL ) {
-		strncpy(path, getenv("SDL_JOYSTICK_DEVICE"), sizeof(path));
-		path[sizeof(path)-1] = '\0';
-		if ( stat(path, &sb) == 0 ) {
-			fd = open(path, O_RDONLY, 0);
-			if ( fd >= 0 ) {
-				/* Assume the user knows what they're doing. */
-				SDL_joylist[numjoysticks] = mystrdup(path);
-				if ( SDL_joylist[numjoysticks] ) {
-					dev_nums[numjoysticks] = sb.st_rdev;
-					++numjoysticks;
-				}
-				close(fd);
-			}
+static void JoyCacheLoad(void)
+{
+	char path[PATH_MAX];
+	char magic[32];
+	FILE *fp;
+	unsigned long rdev, name_hash;
+	unsigned int id[4];
+	int kind;
+	int i;
+	struct joycache_entry *entries;
+
+	if ( JoyCachePath(path, sizeof(path)) == NULL ) {
+		return;
+	}
+	fp = fopen(path, "r");
+	if ( fp == NULL ) {
+		return;
+	}
+	if ( (fgets(magic, sizeof(magic), fp) == NULL) ||
+	     (strncmp(magic, JOYCACHE_MAGIC, strlen(JOYCACHE_MAGIC)) != 0) ) {
+		fclose(fp);
+		return;
+	}
+	while ( fscanf(fp, "%lx %x %x %x %x %lx %d", &rdev,
+	                &id[0], &id[1], &id[2], &id[3], &name_hash, &kind) == 7 ) {
+		entries = (struct joycache_entry *)realloc(SDL_joycache,
+			(SDL_joycache_len+1) * sizeof(*SDL_joycache));
+		if ( entries == NULL ) {
+			break;
 		}
+		SDL_joycache = entries;
+		SDL_joycache[SDL_joycache_len].rdev = (dev_t)rdev;
+		for ( i=0; i<4; ++i ) {
+			SDL_joycache[SDL_joycache_len].id[i] = (Uint16)id[i];
+		}
+		SDL_joycache[SDL_joycache_len].name_hash = (Uint32)name_hash;
+		SDL_joycache[SDL_joycache_len].kind = kind;
+		++SDL_joycache_len;
 	}
+	fclose(fp);
+}
 
-	for ( j=0; j < MAX_JOYSTICKS; ++j ) {
-		sprintf(path, joydev_devices[j]);
+static void JoyCacheSave(void)
+{
+	char path[PATH_MAX];
+	char tmppath[PATH_MAX+16];	/* path, '.' and a pid */
+	FILE *fp;
+	int i;
 
-		/* rcg06302000 replaced access(F_OK) call with stat().
-		 * stat() will fail if the file doesn't exist, so it's
-		 * equivalent behaviour.
-		 */
-		if ( stat(path, &sb) == 0 ) {
-			/* Check to make sure it's not already in list.
-			 * This happens when we see a stick via symlink.
-			 */
-			duplicate = 0;
-			for (n=0; (n<numjoysticks) && !duplicate; ++n) {
-				if ( sb.st_rdev == dev_nums[n] ) {
-					duplicate = 1;
-				}
-			}
-			if (duplicate) {
-				continue;
-			}
-				fd = open(path, O_RDONLY, 0);
-			if ( fd < 0 ) {
-				continue;
-			}
+	if ( JoyCachePath(path, sizeof(path)) == NULL ) {
+		return;
+	}
+
+	/* Write a new copy and rename it over the old, so a concurrent
+	   reader never sees a partial file */
+	snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int)getpid());
+	fp = fopen(tmppath, "w");
+	if ( fp == NULL ) {
+		return;
+	}
+	fprintf(fp, "%s\n", JOYCACHE_MAGIC);
+	for ( i=0; i<SDL_joycache_len; ++i ) {
+		fprintf(fp, "%lx %x %x %x %x %lx %d\n",
+			(unsigned long)SDL_joycache[i].rdev,
+			SDL_joycache[i].id[0], SDL_joycache[i].id[1],
+			SDL_joycache[i].id[2], SDL_joycache[i].id[3],
+			(unsigned long)SDL_joycache[i].name_hash,
+			SDL_joycache[i].kind);
+	}
+	if ( (fclose(fp) != 0) || (rename(tmppath, path) < 0) ) {
+		unlink(tmppath);
+	}
+}
 
 #ifdef USE_INPUT_EVENTS
-#ifdef DEBUG_INPUT_EVENTS
-			printf("Checking %s\n", path);
-#endif
-			if ( (i == 0) && ! EV_IsJoystick(fd) ) {
-				close(fd);
-				continue;
-			}
+/* Find the entry for an identified probe.  This is called from the probe
+   threads, the cache is only changed between batches. */
+static struct joycache_entry *JoyCacheFind(const struct joyprobe *probe)
+{
+	int i;
+
+	if ( !probe->identified ) {
+		return(NULL);
+	}
+	for ( i=0; i<SDL_joycache_len; ++i ) {
+		if ( (SDL_joycache[i].rdev == probe->sb.st_rdev) &&
+		     (memcmp(SDL_joycache[i].id, probe->id, sizeof(probe->id)) == 0) &&
+		     (SDL_joycache[i].name_hash == probe->name_hash) ) {
+			return(&SDL_joycache[i]);
+		}
+	}
+	return(NULL);
+}
 #endif
-			close(fd);
-				
-			/* We're fine, add this joystick */
-			SDL_joylist[numjoysticks] = mystrdup(path);
-			if ( SDL_joylist[numjoysticks] ) {
-				dev_nums[numjoysticks] = sb.st_rdev;
-				++numjoysticks;
-			}
-		} else
+
+static void JoyCacheStore(const struct joyprobe *probe, int kind)
+{
+	struct joycache_entry *entry;
+	int i;
+
+	/* A device now at this minor replaces what was there before */
+	entry = NULL;
+	for ( i=0; i<SDL_joycache_len; ++i ) {
+		if ( SDL_joycache[i].rdev == probe->sb.st_rdev ) {
+			entry = &SDL_joycache[i];
 			break;
+		}
+	}
+	if ( entry == NULL ) {
+		entry = (struct joycache_entry *)realloc(SDL_joycache,
+			(SDL_joycache_len+1) * sizeof(*SDL_joycache));
+		if ( entry == NULL ) {
+			return;
+		}
+		SDL_joycache = entry;
+		entry = &SDL_joycache[SDL_joycache_len++];
+		entry->rdev = probe->sb.st_rdev;
 	}
+	memcpy(entry->id, probe->id, sizeof(entry->id));
+	entry->name_hash = probe->name_hash;
+	entry->kind = kind;
+	SDL_joycache_dirty = SDL_TRUE;
+}
 
+/* Open a candidate node and find out what it is.
+   This runs on a probe thread, so it only touches its own joyprobe.
+ */
+static int JoystickProbe(void *data)
+{
+	struct joyprobe *probe = (struct joyprobe *)data;
 #ifdef USE_INPUT_EVENTS
-	/* This is a special case...
-	   If the event devices are valid then the joystick devices
-	   will be duplicates but without extra information about their
-	   hats or balls. Unfortunately, the event devices can't
-	   currently be calibrated, so it's a win-lose situation.
-	   So : /dev/input/eventX = /dev/input/jsY = /dev/jsY
-	*/
-	if ( (i == 0) && (numjoysticks > 0) )
-		break;
+	struct joycache_entry *cached;
+	int kind;
+#endif
+	int fd;
+
+	fd = open(probe->path, O_RDONLY, 0);
+	if ( fd < 0 ) {
+		/* Might just be permissions this time, don't remember it */
+		probe->kind = JOYKIND_NONE;
+		return(0);
+	}
+#ifdef USE_INPUT_EVENTS
+#ifdef DEBUG_INPUT_EVENTS
+	printf("Checking %s\n", probe->path);
+#endif
+	if ( probe->kind != JOYKIND_PS2PAD ) {
+		if ( EV_Identify(fd, probe) &&
+		     ((cached = JoyCacheFind(probe)) != NULL) ) {
+			kind = cached->kind;
+		} else {
+			kind = EV_IsJoystick(fd) ? JOYKIND_EVDEV : JOYKIND_NONE;
+			probe->cacheable = probe->identified;
+		}
+		if ( kind == JOYKIND_EVDEV ) {
+			probe->kind = JOYKIND_EVDEV;
+		} else if ( probe->kind == JOYKIND_EVDEV ) {
+			probe->kind = JOYKIND_NONE;
+		}
+	}
 #endif
+	if ( probe->kind == JOYKIND_ANY ) {
+		/* Assume the user knows what they're doing. */
+		probe->kind = JOYKIND_PS2PAD;
+	}
+	close(fd);
+	return(0);
+}
 
-	ps2padstat_fd = open("/dev/ps2padstat", O_RDONLY | O_NONBLOCK);
+/* Probe every candidate, several at once */
+static void JoystickProbeAll(struct joyprobe *probes, int nprobes)
+{
+	SDL_Thread *threads[MAX_PROBE_THREADS];
+	struct joyprobe *pending[MAX_PROBE_THREADS];
+	int npending;
+	int i, j;
+
+	npending = 0;
+	for ( i=0; i<=nprobes; ++i ) {
+		if ( i < nprobes ) {
+			pending[npending++] = &probes[i];
+			if ( npending < MAX_PROBE_THREADS ) {
+				continue;
+			}
+		}
 
-	return(numjoysticks);
+		/* Run the batch, the last probe on this thread */
+		for ( j=0; j<npending-1; ++j ) {
+			threads[j] = SDL_CreateThread(JoystickProbe, pending[j]);
+			if ( threads[j] == NULL ) {
+				JoystickProbe(pending[j]);
+			}
+		}
+		if ( npending > 0 ) {
+			JoystickProbe(pending[npending-1]);
+		}
+		for ( j=0; j<npending-1; ++j ) {
+			if ( threads[j] ) {
+				SDL_WaitThread(threads[j], NULL);
+			}
+		}
+		for ( j=0; j<npending; ++j ) {
+			/* Only what the event device checks found is kept */
+			if ( pending[j]->cacheable ) {
+				JoyCacheStore(pending[j],
+					(pending[j]->kind == JOYKIND_EVDEV) ?
+					JOYKIND_EVDEV : JOYKIND_NONE);
+			}
+		}
+		npending = 0;
+	}
 }
 
-/* Function to get the device-dependent name of a joystick */
-const char *SDL_SYS_JoystickName(int index)
+/* Add a candidate node, unless it doesn't exist or was seen via a symlink */
+static int JoystickAddProbe(struct joyprobe *probes, int nprobes,
+                            const char *path, int kind)
 {
-	char * name;
-	char * cat_buffer;
+	struct stat sb;
+	int n;
 
-	struct ps2pad_stat joystick_port_status[MAX_JOYSTICKS];
-	int joystick_type;
+	if ( nprobes >= MAX_PROBE_NODES ) {
+		return(-1);
+	}
+	/* rcg06302000 replaced access(F_OK) call with stat().
+	 * stat() will fail if the file doesn't exist, so it's
+	 * equivalent behaviour.
+	 */
+	if ( stat(path, &sb) < 0 ) {
+		return(-1);
+	}
+	/* Check to make sure it's not already in list.
+	 * This happens when we see a stick via symlink.
+	 */
+	for ( n=0; n<nprobes; ++n ) {
+		if ( sb.st_rdev == probes[n].sb.st_rdev ) {
+			return(0);
+		}
+	}
+	probes[nprobes].path = mystrdup(path);
+	if ( probes[nprobes].path == NULL ) {
+		return(0);
+	}
+	probes[nprobes].sb = sb;
+	probes[nprobes].kind = kind;
+	probes[nprobes].cacheable = SDL_FALSE;
+	probes[nprobes].identified = SDL_FALSE;
+	return(1);
+}
 
-	name = (char *)malloc(128);
-	cat_buffer = (char *)malloc(64);
+/* The controller mapping database.
+   Each line of $SDL_JOYSTICK_MAPPINGS describes one pad type:
 
-	read(ps2padstat_fd, joystick_port_status, sizeof(joystick_port_status));
+	<pad> [port=<n>] [buttons=<b>,...] [axes=[-]<a>,...] [hats=<n>]
+	      [balls=<n>] [actuators=<m>,...]
 
-	joystick_type = PS2PAD_TYPE(joystick_port_status[index].type);
-	
-	/* Build up string to return using strcat() to combine */
-	sprintf(name, "port %d:  ", joystick_port_status[index].portslot>>4);
+   <pad> is a pad type name as reported by SDL_JoystickName() (quoted with
+   ' if it contains spaces) or a PS2PAD_TYPE number.  buttons lists, in SDL
+   order, the physical button (0-11, in the order of ps2pad_buttons) for
+   each SDL button, axes does the same for the physical axes (0-3, in the
+   order of ps2pad_axes) with a leading '-' to invert one, and actuators
+   for the physical actuators.  Lines starting with # are comments.
 
-	switch(joystick_type)
-	{
-		case PS2PAD_TYPE_NEJICON:	sprintf(cat_buffer, "Nejicon"); break;
+   SDL_LINUX_JOYSTICK="'<name>' <naxes> <nhats> <nballs>" is still honoured
+   and overrides the database for the one pad it names, within what the
+   pad can report: <naxes> is capped at the 4 PS2 pad axes and ignored for
+   pads without any (digital pads and light guns), and <nhats> only turns
+   the single d-pad hat on or off.  <nballs> is used as given.
 
-		case PS2PAD_TYPE_DIGITAL: 	sprintf(cat_buffer, "Digital"); break;
+   The file is mapped and compiled once at init into a table indexed by
+   port and pad type, so opening a pad only has to look up one slot.
+ */
+#define JOYMAP_TYPES	16	/* PS2PAD_TYPE() is a 4 bit field */
+#define JOYMAP_LINE	256
+
+#define JOYMAP_BUTTONS	0x01
+#define JOYMAP_AXES	0x02
+#define JOYMAP_HATS	0x04
+#define JOYMAP_BALLS	0x08
+#define JOYMAP_ACTUATORS	0x10
+
+static struct joymap {
+	int fields;		/* JOYMAP_* fields the mapping overrides */
+	int nbuttons;
+	Uint8 buttons[NUM_BUTTONS];	/* Physical button for each SDL button */
+	int naxes;
+	Uint8 axes[NUM_AXES];		/* Physical axis for each SDL axis */
+	Uint8 axis_invert;		/* Bit set for each inverted SDL axis */
+	int nhats;
+	int nballs;
+	int nactuators;
+	Uint8 actuators[MAX_ACTUATORS];	/* Physical actuator for each SDL actuator */
+} SDL_joymap[MAX_JOYSTICKS][JOYMAP_TYPES];
+
+/* Find the pad type from its name or number, or -1 if unknown */
+static int JoyMapPadType(const char *name)
+{
+	int i;
+	char *end;
+	long type;
 
-		case PS2PAD_TYPE_ANALOG: 	sprintf(cat_buffer, "Analog"); break;
+	for ( i=0; i<(int)(sizeof(ps2pad_names)/sizeof(ps2pad_names[0])); ++i ) {
+		if ( strcmp(name, ps2pad_names[i].name) == 0 ) {
+			return(ps2pad_names[i].type);
+		}
+	}
+	type = strtol(name, &end, 0);
+	if ( (*name == '\0') || (*end != '\0') || (type < 0) || (type >= JOYMAP_TYPES) ) {
+		return(-1);
+	}
+	return((int)type);
+}
 
-		case PS2PAD_TYPE_DUALSHOCK: 	sprintf(cat_buffer, "DualShock 1/2"); break;
+/* Parse a comma separated list of physical indices below limit */
+static int JoyMapParseList(char *value, Uint8 *list, int max, int limit, Uint8 *invert)
+{
+	char *item, *save;
+	int n, entry;
 
-		default: 			sprintf(cat_buffer, "Not connected"); break;
+	n = 0;
+	if ( invert ) {
+		*invert = 0;
+	}
+	for ( item=strtok_r(value, ",", &save); item; item=strtok_r(NULL, ",", &save) ) {
+		if ( n >= max ) {
+			return(-1);
+		}
+		if ( (*item == '-') && invert ) {
+			*invert |= (1 << n);
+			++item;
+		}
+		if ( (sscanf(item, "%d", &entry) != 1) || (entry < 0) || (entry >= limit) ) {
+			return(-1);
+		}
+		list[n++] = entry;
+	}
+	return(n);
+}
+
+/* Compile one database line into SDL_joymap */
+static void JoyMapCompileLine(char *line)
+{
+	struct joymap map;
+	char *name, *field, *value, *save;
+	int type, port, i;
+
+	while ( (*line == ' ') || (*line == '\t') ) {
+		++line;
+	}
+	if ( (*line == '#') || (*line == '\0') ) {
+		return;
+	}
+	if ( *line == '\'' ) {
+		name = ++line;
+		line = strchr(line, '\'');
+		if ( line == NULL ) {
+			return;
+		}
+		*line++ = '\0';
+	} else {
+		name = line;
+		line += strcspn(line, " \t");
+		if ( *line ) {
+			*line++ = '\0';
+		}
+	}
+	type = JoyMapPadType(name);
+	if ( type < 0 ) {
+		SDL_SetError("Unknown pad type in joystick mapping: %s\n", name);
+		return;
+	}
+
+	memset(&map, 0, sizeof(map));
+	port = -1;
+	for ( field=strtok_r(line, " \t", &save); field; field=strtok_r(NULL, " \t", &save) ) {
+		value = strchr(field, '=');
+		if ( value == NULL ) {
+			continue;
+		}
+		*value++ = '\0';
+		if ( strcmp(field, "port") == 0 ) {
+			port = atoi(value);
+		} else if ( strcmp(field, "buttons") == 0 ) {
+			map.nbuttons = JoyMapParseList(value, map.buttons,
+				NUM_BUTTONS, NUM_BUTTONS, NULL);
+			map.fields |= JOYMAP_BUTTONS;
+		} else if ( strcmp(field, "axes") == 0 ) {
+			map.naxes = JoyMapParseList(value, map.axes,
+				NUM_AXES, NUM_AXES, &map.axis_invert);
+			map.fields |= JOYMAP_AXES;
+		} else if ( strcmp(field, "actuators") == 0 ) {
+			map.nactuators = JoyMapParseList(value, map.actuators,
+				MAX_ACTUATORS, MAX_ACTUATORS, NULL);
+			map.fields |= JOYMAP_ACTUATORS;
+		} else if ( strcmp(field, "hats") == 0 ) {
+			map.nhats = atoi(value);
+			map.fields |= JOYMAP_HATS;
+		} else if ( strcmp(field, "balls") == 0 ) {
+			map.nballs = atoi(value);
+			map.fields |= JOYMAP_BALLS;
+		}
+	}
+	if ( (map.nbuttons < 0) || (map.naxes < 0) || (map.nactuators < 0) ) {
+		SDL_SetError("Bad joystick mapping for %s\n", name);
+		return;
 	}
-	strcat(name, cat_buffer);
-	
-	sprintf(cat_buffer, " (type: %d)", joystick_type);
-	strcat(name, cat_buffer);
 
-	free(cat_buffer);
-	return name;
+	/* A mapping without a port applies to every port */
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		if ( (port < 0) || (port == i) ) {
+			SDL_joymap[i][type] = map;
+		}
+	}
 }
 
-static int allocate_hatdata(SDL_Joystick *joystick)
+/* Compile $SDL_JOYSTICK_MAPPINGS and SDL_LINUX_JOYSTICK into SDL_joymap */
+static void JoyMapCompile(void)
 {
+	const char *file;
+	char *env, env_name[128];
+	char line[JOYMAP_LINE];
+	struct stat sb;
+	const char *data;
+	size_t pos, len;
+	int fd;
+	int port, type, tmp_naxes, tmp_nhats, tmp_nballs;
 	int i;
 
-	joystick->hwdata->hats = (struct hwdata_hat *)malloc(
-		joystick->nhats * sizeof(struct hwdata_hat));
-	if ( joystick->hwdata->hats == NULL ) {
-		return(-1);
+	memset(SDL_joymap, 0, sizeof(SDL_joymap));
+
+	file = getenv("SDL_JOYSTICK_MAPPINGS");
+	if ( file && ((fd = open(file, O_RDONLY, 0)) >= 0) ) {
+		if ( (fstat(fd, &sb) == 0) && (sb.st_size > 0) ) {
+			data = (const char *)mmap(NULL, sb.st_size, PROT_READ,
+			                          MAP_PRIVATE, fd, 0);
+			if ( data != MAP_FAILED ) {
+				for ( pos=0; pos<(size_t)sb.st_size; pos += len+1 ) {
+					len = 0;
+					while ( (pos+len < (size_t)sb.st_size) &&
+					        (data[pos+len] != '\n') ) {
+						++len;
+					}
+					if ( len < sizeof(line) ) {
+						memcpy(line, data+pos, len);
+						line[len] = '\0';
+						JoyMapCompileLine(line);
+					}
+				}
+				munmap((void *)data, sb.st_size);
+			}
+		}
+		close(fd);
 	}
-	for ( i=0; i<joystick->nhats; ++i ) {
-		joystick->hwdata->hats[i].axis[0] = 1;
-		joystick->hwdata->hats[i].axis[1] = 1;
+
+	/* User environment joystick support */
+	if ( (env = getenv("SDL_LINUX_JOYSTICK")) ) {
+		strcpy(env_name, "");
+		if ( *env == '\'' && sscanf(env, "'%127[^']s'", env_name) == 1 )
+			env += strlen(env_name)+2;
+		else if ( sscanf(env, "%127s", env_name) == 1 )
+			env += strlen(env_name);
+
+		/* The name is the one built by SDL_SYS_JoystickName() */
+		if ( (sscanf(env_name, "port %d:", &port) == 1) &&
+		     (port >= 0) && (port < MAX_JOYSTICKS) &&
+		     strstr(env_name, "(type: ") &&
+		     (sscanf(strstr(env_name, "(type: "), "(type: %d)", &type) == 1) &&
+		     (type >= 0) && (type < JOYMAP_TYPES) &&
+		     (sscanf(env, "%d %d %d", &tmp_naxes, &tmp_nhats, &tmp_nballs) == 3) ) {
+			SDL_joymap[port][type].fields |= (JOYMAP_AXES|JOYMAP_HATS|JOYMAP_BALLS);
+			SDL_joymap[port][type].naxes = tmp_naxes;
+			for ( i=0; i<NUM_AXES; ++i ) {
+				SDL_joymap[port][type].axes[i] = i;
+			}
+			SDL_joymap[port][type].axis_invert = 0;
+			SDL_joymap[port][type].nhats = tmp_nhats;
+			SDL_joymap[port][type].nballs = tmp_nballs;
+		}
 	}
-	return(0);
 }
 
-static int allocate_balldata(SDL_Joystick *joystick)
+/* Sharing the pads between processes.
+   With SDL_JOYSTICK_SHM_PUBLISH=<name> this process owns the devices and
+   publishes every frame of its open joysticks into the POSIX shared memory
+   object <name>.  With SDL_JOYSTICK_SHM=<name> the devices are left alone
+   and the joysticks come from that object instead, so reading them costs
+   no system calls.  The owner is the only writer: each pad's description
+   is guarded by a seqlock, and its frames go into a ring that readers
+   follow by frame_count.  Frames keep the owner's timestamps, which
+   readers move onto their own clock with the owner's clock_base.
+ */
+#define JOYSHM_MAGIC	0x4A534432	/* "JSD2" */
+#define JOYSHM_FRAMES	64		/* Must be a power of two */
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 1)))
+#define JOYSHM_BARRIER()	__sync_synchronize()
+#elif defined(__mips__)
+#define JOYSHM_BARRIER()	__asm__ __volatile__("sync" : : : "memory")
+#else
+#define JOYSHM_BARRIER()	__asm__ __volatile__("" : : : "memory")
+#endif
+
+struct joyshm_pad {
+	/* The description, odd seq while it is being changed */
+	volatile Uint32 seq;
+	Uint32 present;
+	char name[128];
+	int naxes;
+	int nbuttons;
+	int nhats;
+
+	/* Every frame recorded, the newest is the current state */
+	volatile Uint32 frame_count;
+	struct joyframe frames[JOYSHM_FRAMES];
+};
+
+static struct joyshm {
+	volatile Uint32 magic;		/* Set once the segment is ready */
+	Uint32 clock_base;		/* The owner's SHM_ClockBase() */
+	struct joyshm_pad pads[MAX_JOYSTICKS];
+} *SDL_joyshm = NULL;
+static char *SDL_joyshm_name = NULL;
+static SDL_bool SDL_joyshm_owner = SDL_FALSE;
+
+/* The wall clock in milliseconds less SDL_GetTicks().  The difference
+   between two processes' values turns one's ticks into the other's. */
+static Uint32 SHM_ClockBase(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return((Uint32)now.tv_sec * 1000u + (Uint32)now.tv_usec / 1000u - SDL_GetTicks());
+}
+
+/* Create the shared memory object and start publishing into it */
+static int SHM_Publish(const char *name)
 {
+	struct joyshm_pad *pad;
+	int fd;
 	int i;
 
-	joystick->hwdata->balls = (struct hwdata_ball *)malloc(
-		joystick->nballs * sizeof(struct hwdata_ball));
-	if ( joystick->hwdata->balls == NULL ) {
+	fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if ( fd < 0 ) {
+		SDL_SetError("Unable to create shared memory %s\n", name);
 		return(-1);
 	}
-	for ( i=0; i<joystick->nballs; ++i ) {
-		joystick->hwdata->balls[i].axis[0] = 0;
-		joystick->hwdata->balls[i].axis[1] = 0;
+	if ( ftruncate(fd, sizeof(*SDL_joyshm)) < 0 ) {
+		SDL_SetError("Unable to size shared memory %s\n", name);
+		close(fd);
+		return(-1);
+	}
+	SDL_joyshm = (struct joyshm *)mmap(NULL, sizeof(*SDL_joyshm),
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( SDL_joyshm == (struct joyshm *)MAP_FAILED ) {
+		SDL_joyshm = NULL;
+		SDL_SetError("Unable to map shared memory %s\n", name);
+		return(-1);
+	}
+
+	/* Readers may still be attached to an old segment, so keep the
+	   frame and description counts running and just mark every pad
+	   absent.  The seq is made odd first, in case the last publisher
+	   stopped half way through a change. */
+	SDL_joyshm->magic = 0;
+	JOYSHM_BARRIER();
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		pad = &SDL_joyshm->pads[i];
+		pad->seq |= 1;
+		JOYSHM_BARRIER();
+		pad->present = 0;
+		memset(pad->name, 0, sizeof(pad->name));
+		pad->naxes = 0;
+		pad->nbuttons = 0;
+		pad->nhats = 0;
+		JOYSHM_BARRIER();
+		++pad->seq;
 	}
+	SDL_joyshm->clock_base = SHM_ClockBase();
+	JOYSHM_BARRIER();
+	SDL_joyshm->magic = JOYSHM_MAGIC;
+
+	SDL_joyshm_name = mystrdup(name);
+	SDL_joyshm_owner = SDL_TRUE;
 	return(0);
 }
 
-static SDL_bool JS_ConfigJoystick(SDL_Joystick *joystick, int fd)
+/* Map a published shared memory object, returning how many pads it has */
+static int SHM_Attach(const char *name)
 {
-	SDL_bool handled;
-	int tmp_naxes, tmp_nhats, tmp_nballs;
-	const char *name;
-	char *env, env_name[128];
-	struct ps2pad_stat joystick_port_status[MAX_JOYSTICKS];
-	struct ps2pad_act actuator_align;
-	int joystick_type;
-	int index;
+	int fd;
 
-	handled = SDL_FALSE;
-	joystick_type = -1;
-	index = joystick->index;
+	fd = shm_open(name, O_RDONLY, 0);
+	if ( fd < 0 ) {
+		SDL_SetError("No joysticks published as %s\n", name);
+		return(-1);
+	}
+	SDL_joyshm = (struct joyshm *)mmap(NULL, sizeof(*SDL_joyshm),
+		PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( SDL_joyshm == (struct joyshm *)MAP_FAILED ) {
+		SDL_joyshm = NULL;
+		SDL_SetError("Unable to map shared memory %s\n", name);
+		return(-1);
+	}
+	if ( SDL_joyshm->magic != JOYSHM_MAGIC ) {
+		munmap((void *)SDL_joyshm, sizeof(*SDL_joyshm));
+		SDL_joyshm = NULL;
+		SDL_SetError("Shared memory %s has no joysticks\n", name);
+		return(-1);
+	}
+	SDL_joyshm_name = mystrdup(name);
+	SDL_joyshm_owner = SDL_FALSE;
+	return(MAX_JOYSTICKS);
+}
 
-	read(ps2padstat_fd, joystick_port_status, sizeof(joystick_port_status));
+static void SHM_Detach(void)
+{
+	if ( SDL_joyshm ) {
+		if ( SDL_joyshm_owner ) {
+			SDL_joyshm->magic = 0;
+			shm_unlink(SDL_joyshm_name);
+		}
+		munmap((void *)SDL_joyshm, sizeof(*SDL_joyshm));
+		SDL_joyshm = NULL;
+	}
+	if ( SDL_joyshm_name ) {
+		free(SDL_joyshm_name);
+		SDL_joyshm_name = NULL;
+	}
+}
 
-	joystick_type = PS2PAD_TYPE(joystick_port_status[index].type);
+/* Publish the description of a pad that has just been opened or closed */
+static void SHM_PublishPad(SDL_Joystick *joystick, SDL_bool present)
+{
+	struct joyshm_pad *pad;
+
+	pad = &SDL_joyshm->pads[joystick->index];
+	++pad->seq;
+	JOYSHM_BARRIER();
+	pad->present = present;
+	if ( present ) {
+		strncpy(pad->name, SDL_SYS_JoystickName(joystick->index), sizeof(pad->name));
+		pad->name[sizeof(pad->name)-1] = '\0';
+		pad->naxes = (joystick->naxes < HISTORY_AXES) ? joystick->naxes : HISTORY_AXES;
+		pad->nbuttons = (joystick->nbuttons < HISTORY_BUTTONS) ? joystick->nbuttons : HISTORY_BUTTONS;
+		pad->nhats = (joystick->nhats > 0);
+	}
+	JOYSHM_BARRIER();
+	++pad->seq;
+}
+
+/* Publish a frame just recorded for one of our pads */
+static __inline__ void SHM_PublishFrame(SDL_Joystick *joystick, const struct joyframe *frame)
+{
+	struct joyshm_pad *pad;
+
+	pad = &SDL_joyshm->pads[joystick->index];
+	pad->frames[pad->frame_count & (JOYSHM_FRAMES-1)] = *frame;
+	JOYSHM_BARRIER();
+	++pad->frame_count;
+}
+
+/* Read a consistent copy of a published pad's description */
+static void SHM_ReadPad(int index, struct joyshm_pad *copy)
+{
+	const struct joyshm_pad *pad;
+	Uint32 seq;
+
+	pad = &SDL_joyshm->pads[index];
+	do {
+		seq = pad->seq;
+		JOYSHM_BARRIER();
+		copy->present = pad->present;
+		memcpy(copy->name, pad->name, sizeof(copy->name));
+		copy->naxes = pad->naxes;
+		copy->nbuttons = pad->nbuttons;
+		copy->nhats = pad->nhats;
+		JOYSHM_BARRIER();
+	} while ( (seq & 1) || (seq != pad->seq) );
+	copy->name[sizeof(copy->name)-1] = '\0';
+}
+
+/* Open a joystick published by another process */
+static int SHM_OpenJoystick(SDL_Joystick *joystick)
+{
+	struct joyshm_pad pad;
+
+	SHM_ReadPad(SDL_joylist[joystick->index].port, &pad);
+	if ( !pad.present ) {
+		SDL_SetError("No device published as %s joystick %d\n",
+		             SDL_joyshm_name, SDL_joylist[joystick->index].port);
+		return(-1);
+	}
+
+	joystick->hwdata = (struct joystick_hwdata *)
+	                   malloc(sizeof(*joystick->hwdata));
+	if ( joystick->hwdata == NULL ) {
+		SDL_OutOfMemory();
+		return(-1);
+	}
+	memset(joystick->hwdata, 0, sizeof(*joystick->hwdata));
+	joystick->hwdata->fd = -1;
+	joystick->naxes = pad.naxes;
+	joystick->nbuttons = pad.nbuttons;
+	joystick->nhats = pad.nhats;
+	joystick->nballs = 0;
+	joystick->nactuators = 0;
+
+	/* Start from the current state, the newest frame */
+	joystick->hwdata->shm_frame_count =
+		SDL_joyshm->pads[SDL_joylist[joystick->index].port].frame_count;
+	if ( joystick->hwdata->shm_frame_count > 0 ) {
+		--joystick->hwdata->shm_frame_count;
+	}
+	joystick->hwdata->remote_state.hat = SDL_HAT_CENTERED;
+
+	/* The clocks are matched once here, updates make no system calls */
+	joystick->hwdata->shm_clock_offset = SDL_joyshm->clock_base - SHM_ClockBase();
+	SDL_joyopen[joystick->index] = joystick;
+	return(0);
+}
+
+/* Streaming the pads to another process.
+   With SDL_JOYSTICK_STREAM_EXPORT=<where> (or SDL_JoystickExportStream())
+   every frame of the open joysticks is written as a compact record, and a
+   process started with SDL_JOYSTICK_STREAM=<where> plays them back as its
+   own joysticks.  <where> is either fd:<n>, a descriptor that is already
+   open, or the path of a Unix domain socket, on which the importer listens
+   and to which the exporter connects.
+
+   A record starts with a flags byte:
+ */
+#define JOYSTREAM_PAD		0x03	/* The joystick index */
+#define JOYSTREAM_HAT		0x04	/* A byte with the hat position follows */
+#define JOYSTREAM_BUTTONS	0x08	/* A varint of the changed buttons follows */
+#define JOYSTREAM_AXES		0x10	/* A byte of changed axes follows, then a
+					   zigzag varint with the change of each */
+#define JOYSTREAM_KEY		0x20	/* The changes are from the centered state */
+#define JOYSTREAM_ADD		0x40	/* The joystick was opened */
+#define JOYSTREAM_REMOVE	0x80	/* The joystick was closed */
+/* A frame has a varint of the milliseconds since the previous frame right
+   after the flags, or with JOYSTREAM_KEY of the exporter's clock.
+   JOYSTREAM_ADD is followed by bytes with the number of axes, buttons and
+   hats, and the name, as a length byte and the text.
+   Varints are 7 bits per byte, lowest first, with 0x80 set on all but the
+   last.  Axes are sent with the bottom JOYSTREAM_AXIS_SHIFT bits dropped,
+   which loses nothing for the 8 bit PS2 pad axes.
+ */
+#define JOYSTREAM_AXIS_SHIFT	8
+#define JOYSTREAM_NAME		64
+#define JOYSTREAM_RECORD	(1+5+1+5+1+5*HISTORY_AXES)	/* Largest frame */
+#define JOYSTREAM_BUFFER	4096
+
+static struct joystream {
+	int fd;			/* The stream, -1 when there is none */
+	int listen_fd;		/* The importer's socket, waiting for a connection */
+	SDL_bool export;
+	SDL_bool owned;		/* We opened fd, so we close it */
+	SDL_bool socket;	/* fd is a socket, write it with MSG_NOSIGNAL */
+
+	/* Exporting: the state the importer has, with the axes quantized */
+	struct joyframe sent[MAX_JOYSTICKS];
+	SDL_bool resync[MAX_JOYSTICKS];
+	Uint32 timestamp;
+
+	/* Importing: the joysticks described by the exporter, and their state */
+	struct joystream_pad {
+		SDL_bool present;
+		int naxes;
+		int nbuttons;
+		int nhats;
+		char name[JOYSTREAM_NAME+1];
+		struct joyframe state;
+	} pads[MAX_JOYSTICKS];
+	SDL_bool synced;	/* The exporter's clock has been matched to ours */
+	Uint32 remote_time;
+	Uint32 clock_offset;
+
+	SDL_JoystickStreamStats stats;
+	int len;
+	int tail;		/* Bytes at the front finishing a record cut short */
+	Uint8 buffer[JOYSTREAM_BUFFER];
+} SDL_joystream = { -1, -1 };
+
+static void ApplyRemoteFrame(SDL_Joystick *joystick,
+                             const struct joyframe *frame, Uint32 timestamp);
+
+static __inline__ Uint8 *STREAM_PutVarint(Uint8 *p, Uint32 value)
+{
+	while ( value >= 0x80 ) {
+		*p++ = (Uint8)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (Uint8)value;
+	return(p);
+}
+
+/* Returns the bytes used, or 0 if the varint isn't all there yet */
+static __inline__ int STREAM_GetVarint(const Uint8 *p, const Uint8 *end, Uint32 *value)
+{
+	int i;
+
+	*value = 0;
+	for ( i=0; (p+i < end) && (i < 5); ++i ) {
+		*value |= (Uint32)(p[i] & 0x7F) << (7*i);
+		if ( !(p[i] & 0x80) ) {
+			return(i+1);
+		}
+	}
+	return(0);
+}
+
+/* Open <where>, as described above */
+static int STREAM_Open(const char *where, SDL_bool export)
+{
+	struct sockaddr_un addr;
+	struct stat sb;
+	int fd;
+
+	SDL_joystream.fd = -1;
+	SDL_joystream.listen_fd = -1;
+	SDL_joystream.export = SDL_FALSE;
+	SDL_joystream.owned = SDL_FALSE;
+	SDL_joystream.len = 0;
+	SDL_joystream.tail = 0;
+	SDL_joystream.synced = SDL_FALSE;
+	memset(&SDL_joystream.stats, 0, sizeof(SDL_joystream.stats));
+
+	if ( strncmp(where, "fd:", 3) == 0 ) {
+		fd = atoi(where+3);
+		if ( (fd < 0) || (fcntl(fd, F_GETFL) < 0) ) {
+			SDL_SetError("Joystick stream %s isn't open\n", where);
+			return(-1);
+		}
+	} else {
+		if ( strlen(where) >= sizeof(addr.sun_path) ) {
+			SDL_SetError("Joystick stream socket name too long\n");
+			return(-1);
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, where);
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if ( fd < 0 ) {
+			SDL_SetError("Unable to create a socket for %s\n", where);
+			return(-1);
+		}
+		if ( export ) {
+			if ( connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ) {
+				SDL_SetError("Unable to connect to %s\n", where);
+				close(fd);
+				return(-1);
+			}
+		} else {
+			/* Clear away a socket left by an importer before us */
+			if ( (lstat(where, &sb) == 0) && S_ISSOCK(sb.st_mode) ) {
+				unlink(where);
+			}
+			if ( (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+			     (listen(fd, 1) < 0) ) {
+				SDL_SetError("Unable to listen on %s\n", where);
+				close(fd);
+				return(-1);
+			}
+			fcntl(fd, F_SETFL, O_NONBLOCK);
+			SDL_joystream.listen_fd = fd;
+			return(0);
+		}
+		SDL_joystream.owned = SDL_TRUE;
+	}
+
+	/* A slow reader must never hold up the joysticks */
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	SDL_joystream.socket = ((fstat(fd, &sb) == 0) && S_ISSOCK(sb.st_mode));
+	SDL_joystream.fd = fd;
+	SDL_joystream.export = export;
+	return(0);
+}
+
+static void STREAM_Close(void)
+{
+	if ( (SDL_joystream.fd >= 0) && SDL_joystream.owned ) {
+		close(SDL_joystream.fd);
+	}
+	if ( SDL_joystream.listen_fd >= 0 ) {
+		close(SDL_joystream.listen_fd);
+	}
+	SDL_joystream.fd = -1;
+	SDL_joystream.listen_fd = -1;
+	SDL_joystream.export = SDL_FALSE;
+	SDL_joystream.len = 0;
+	SDL_joystream.tail = 0;
+}
+
+/* The length of the record at p, or 0 if it isn't all there */
+static int STREAM_RecordLength(const Uint8 *p, const Uint8 *end)
+{
+	const Uint8 *start;
+	Uint32 value;
+	Uint8 mask;
+	int used;
+	int i;
+
+	if ( *p & JOYSTREAM_ADD ) {
+		if ( (end - p) < 5 || (end - p) < (5 + p[4]) ) {
+			return(0);
+		}
+		return(5 + p[4]);
+	}
+	if ( *p & JOYSTREAM_REMOVE ) {
+		return(1);
+	}
+
+	start = p;
+	p += 1;
+	used = STREAM_GetVarint(p, end, &value);
+	if ( used == 0 ) {
+		return(0);
+	}
+	p += used;
+	if ( *start & JOYSTREAM_HAT ) {
+		if ( p >= end ) {
+			return(0);
+		}
+		p += 1;
+	}
+	if ( *start & JOYSTREAM_BUTTONS ) {
+		used = STREAM_GetVarint(p, end, &value);
+		if ( used == 0 ) {
+			return(0);
+		}
+		p += used;
+	}
+	if ( *start & JOYSTREAM_AXES ) {
+		if ( p >= end ) {
+			return(0);
+		}
+		mask = *p++;
+		for ( i=0; i<HISTORY_AXES; ++i ) {
+			if ( mask & (1 << i) ) {
+				used = STREAM_GetVarint(p, end, &value);
+				if ( used == 0 ) {
+					return(0);
+				}
+				p += used;
+			}
+		}
+	}
+	return(p - start);
+}
+
+/* Write out the records queued since the last flush, in one call */
+static void STREAM_Flush(void)
+{
+	int written;
+	int used;
+	int i;
+
+	if ( SDL_joystream.len == 0 ) {
+		return;
+	}
+	if ( SDL_joystream.socket ) {
+		written = send(SDL_joystream.fd, SDL_joystream.buffer,
+		               SDL_joystream.len, MSG_NOSIGNAL);
+	} else {
+		written = write(SDL_joystream.fd, SDL_joystream.buffer,
+		                SDL_joystream.len);
+	}
+	if ( written < 0 ) {
+		if ( (errno != EAGAIN) && (errno != EINTR) ) {
+			/* The reader has gone away */
+			STREAM_Close();
+		}
+		return;
+	}
+	++SDL_joystream.stats.calls;
+	SDL_joystream.stats.bytes += written;
+
+	/* Note how much of a record cut short is left, it has to be sent */
+	if ( written < SDL_joystream.tail ) {
+		SDL_joystream.tail -= written;
+	} else {
+		for ( i=SDL_joystream.tail; i<written; i+=used ) {
+			used = STREAM_RecordLength(SDL_joystream.buffer + i,
+			                           SDL_joystream.buffer + SDL_joystream.len);
+			if ( used == 0 ) {
+				i = SDL_joystream.len;
+				break;
+			}
+		}
+		SDL_joystream.tail = i - written;
+	}
+	SDL_joystream.len -= written;
+	if ( SDL_joystream.len > 0 ) {
+		memmove(SDL_joystream.buffer, SDL_joystream.buffer+written,
+		        SDL_joystream.len);
+	}
+}
+
+/* Put a record saying a joystick was opened or closed in the buffer,
+   which has room for it */
+static void STREAM_PutPad(SDL_Joystick *joystick, SDL_bool present)
+{
+	const char *name;
+	Uint8 *p;
+	int len;
+
+	p = SDL_joystream.buffer + SDL_joystream.len;
+	if ( present ) {
+		name = SDL_SYS_JoystickName(joystick->index);
+		len = strlen(name);
+		if ( len > JOYSTREAM_NAME ) {
+			len = JOYSTREAM_NAME;
+		}
+		*p++ = JOYSTREAM_ADD | joystick->index;
+		*p++ = (joystick->naxes < HISTORY_AXES) ? joystick->naxes : HISTORY_AXES;
+		*p++ = (joystick->nbuttons < HISTORY_BUTTONS) ? joystick->nbuttons : HISTORY_BUTTONS;
+		*p++ = (joystick->nhats > 0);
+		*p++ = len;
+		memcpy(p, name, len);
+		p += len;
+	} else {
+		*p++ = JOYSTREAM_REMOVE | joystick->index;
+	}
+	SDL_joystream.len = p - SDL_joystream.buffer;
+
+	/* The next frame is sent whole */
+	SDL_joystream.resync[joystick->index] = SDL_TRUE;
+}
+
+/* Make room for a record of up to size bytes.  If the reader is too far
+   behind, start it over from what it can still get whole.  A record it
+   has had part of is kept, or it would lose its place.
+ */
+static void STREAM_Reserve(int size)
+{
+	int i;
+
+	if ( (SDL_joystream.len + size) <= JOYSTREAM_BUFFER ) {
+		return;
+	}
+	STREAM_Flush();
+	if ( (SDL_joystream.len + size) <= JOYSTREAM_BUFFER ) {
+		return;
+	}
+	++SDL_joystream.stats.dropped;
+	SDL_joystream.len = SDL_joystream.tail;
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		if ( SDL_joyopen[i] ) {
+			STREAM_PutPad(SDL_joyopen[i], SDL_TRUE);
+		} else {
+			SDL_joystream.buffer[SDL_joystream.len++] =
+				JOYSTREAM_REMOVE | i;
+		}
+	}
+}
+
+/* Queue a record saying a joystick was opened or closed */
+static void STREAM_ExportPad(SDL_Joystick *joystick, SDL_bool present)
+{
+	STREAM_Reserve(5 + JOYSTREAM_NAME);
+	STREAM_PutPad(joystick, present);
+}
+
+/* Queue the changes in a frame just recorded for one of our joysticks */
+static void STREAM_ExportFrame(SDL_Joystick *joystick, const struct joyframe *frame)
+{
+	struct joyframe *sent;
+	Uint8 *flags;
+	Uint8 *mask;
+	Uint8 *p;
+	Uint32 changed;
+	Sint16 value;
+	int i;
+
+	STREAM_Reserve(JOYSTREAM_RECORD);
+
+	sent = &SDL_joystream.sent[joystick->index];
+	p = SDL_joystream.buffer + SDL_joystream.len;
+	flags = p++;
+	*flags = joystick->index;
+	if ( SDL_joystream.resync[joystick->index] ) {
+		SDL_joystream.resync[joystick->index] = SDL_FALSE;
+		memset(sent, 0, sizeof(*sent));
+		sent->hat = SDL_HAT_CENTERED;
+		*flags |= JOYSTREAM_KEY;
+	}
+	if ( *flags & JOYSTREAM_KEY ) {
+		/* After a drop the importer can't know the time since the last
+		   record it got */
+		p = STREAM_PutVarint(p, frame->timestamp);
+	} else {
+		p = STREAM_PutVarint(p, frame->timestamp - SDL_joystream.timestamp);
+	}
+
+	if ( frame->hat != sent->hat ) {
+		*flags |= JOYSTREAM_HAT;
+		*p++ = sent->hat = frame->hat;
+	}
+	changed = frame->buttons ^ sent->buttons;
+	if ( changed ) {
+		*flags |= JOYSTREAM_BUTTONS;
+		p = STREAM_PutVarint(p, changed);
+		sent->buttons = frame->buttons;
+	}
+	mask = p++;
+	*mask = 0;
+	for ( i=0; (i < joystick->naxes) && (i < HISTORY_AXES); ++i ) {
+		value = frame->axes[i] >> JOYSTREAM_AXIS_SHIFT;
+		if ( value != sent->axes[i] ) {
+			*mask |= (1 << i);
+			/* Zigzag, so that small changes either way are short */
+			changed = (Uint32)(value - sent->axes[i]);
+			p = STREAM_PutVarint(p, (changed << 1) ^ -(changed >> 31));
+			sent->axes[i] = value;
+		}
+	}
+	if ( *mask ) {
+		*flags |= JOYSTREAM_AXES;
+	} else {
+		--p;
+	}
+
+	/* Changes too small to survive quantizing aren't worth a record */
+	if ( *flags & (JOYSTREAM_HAT|JOYSTREAM_BUTTONS|JOYSTREAM_AXES|JOYSTREAM_KEY) ) {
+		SDL_joystream.timestamp = frame->timestamp;
+		SDL_joystream.len = p - SDL_joystream.buffer;
+		++SDL_joystream.stats.frames;
+	}
+}
+
+/* Decode one record, returning its length, or 0 if it isn't all there */
+static int STREAM_Decode(const Uint8 *p, const Uint8 *end, SDL_bool deliver)
+{
+	const Uint8 *start;
+	struct joystream_pad *pad;
+	SDL_Joystick *joystick;
+	Uint32 value;
+	Uint8 mask;
+	int used;
+	int i;
+	static struct joystream_pad unknown;
+
+	/* Records for joysticks we don't have are decoded, then dropped */
+	start = p;
+	pad = &unknown;
+	joystick = NULL;
+	if ( (*p & JOYSTREAM_PAD) < MAX_JOYSTICKS ) {
+		pad = &SDL_joystream.pads[*p & JOYSTREAM_PAD];
+		if ( SDL_joylist[*p & JOYSTREAM_PAD].kind == JOYKIND_STREAM ) {
+			joystick = SDL_joyopen[*p & JOYSTREAM_PAD];
+		}
+	}
+
+	used = STREAM_RecordLength(p, end);
+	if ( used == 0 ) {
+		return(0);
+	}
+
+	if ( *p & JOYSTREAM_ADD ) {
+		/* Don't trust the exporter with more than we can hold */
+		pad->present = SDL_TRUE;
+		pad->naxes = (p[1] < HISTORY_AXES) ? p[1] : HISTORY_AXES;
+		pad->nbuttons = (p[2] < HISTORY_BUTTONS) ? p[2] : HISTORY_BUTTONS;
+		pad->nhats = (p[3] > 0);
+		used = (p[4] < JOYSTREAM_NAME) ? p[4] : JOYSTREAM_NAME;
+		memcpy(pad->name, p+5, used);
+		pad->name[used] = '\0';
+		memset(&pad->state, 0, sizeof(pad->state));
+		pad->state.hat = SDL_HAT_CENTERED;
+		return(5 + p[4]);
+	}
+	if ( *p & JOYSTREAM_REMOVE ) {
+		pad->present = SDL_FALSE;
+		memset(&pad->state, 0, sizeof(pad->state));
+		pad->state.hat = SDL_HAT_CENTERED;
+		if ( joystick && deliver ) {
+			ApplyRemoteFrame(joystick, &pad->state, SDL_GetTicks());
+		}
+		return(1);
+	}
+
+	/* A frame, which is all there */
+	end = start + used;
+	p = start + 1;
+	p += STREAM_GetVarint(p, end, &value);
+	if ( *start & JOYSTREAM_KEY ) {
+		SDL_joystream.remote_time = value;
+		memset(&pad->state, 0, sizeof(pad->state));
+		pad->state.hat = SDL_HAT_CENTERED;
+	} else {
+		SDL_joystream.remote_time += value;
+	}
+	if ( *start & JOYSTREAM_HAT ) {
+		pad->state.hat = *p++;
+	}
+	if ( *start & JOYSTREAM_BUTTONS ) {
+		p += STREAM_GetVarint(p, end, &value);
+		pad->state.buttons ^= value;
+	}
+	if ( *start & JOYSTREAM_AXES ) {
+		mask = *p++;
+		for ( i=0; i<HISTORY_AXES; ++i ) {
+			if ( mask & (1 << i) ) {
+				p += STREAM_GetVarint(p, end, &value);
+				value = (value >> 1) ^ -(value & 1);
+				pad->state.axes[i] = (Sint16)
+					(((pad->state.axes[i] >> JOYSTREAM_AXIS_SHIFT) + (Sint32)value)
+					 << JOYSTREAM_AXIS_SHIFT);
+			}
+		}
+	}
+	++SDL_joystream.stats.frames;
+
+	if ( joystick && deliver ) {
+		if ( !SDL_joystream.synced ) {
+			SDL_joystream.clock_offset = SDL_GetTicks() - SDL_joystream.remote_time;
+			SDL_joystream.synced = SDL_TRUE;
+		}
+		pad->state.timestamp = SDL_joystream.remote_time + SDL_joystream.clock_offset;
+		ApplyRemoteFrame(joystick, &pad->state, pad->state.timestamp);
+	}
+	return(end - start);
+}
+
+/* Read and decode whatever the exporter has sent.  The joysticks are only
+   sent events if deliver is set, otherwise just the state is followed. */
+static void STREAM_Read(SDL_bool deliver)
+{
+	int i;
+	int used;
+	int got;
+
+	if ( SDL_joystream.fd < 0 ) {
+		if ( SDL_joystream.listen_fd < 0 ) {
+			return;
+		}
+		SDL_joystream.fd = accept(SDL_joystream.listen_fd, NULL, NULL);
+		if ( SDL_joystream.fd < 0 ) {
+			return;
+		}
+		fcntl(SDL_joystream.fd, F_SETFL, O_NONBLOCK);
+		SDL_joystream.owned = SDL_TRUE;
+		SDL_joystream.len = 0;
+		SDL_joystream.synced = SDL_FALSE;
+		SDL_joystream.remote_time = 0;
+	}
+
+	for ( ;; ) {
+		got = read(SDL_joystream.fd, SDL_joystream.buffer + SDL_joystream.len,
+		           JOYSTREAM_BUFFER - SDL_joystream.len);
+		if ( got <= 0 ) {
+			if ( (got == 0) ||
+			     ((errno != EAGAIN) && (errno != EINTR)) ) {
+				/* The exporter has gone, wait for another one */
+				if ( SDL_joystream.owned ) {
+					close(SDL_joystream.fd);
+				}
+				SDL_joystream.fd = -1;
+				SDL_joystream.len = 0;
+				for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+					if ( SDL_joystream.pads[i].present ) {
+						Uint8 remove = JOYSTREAM_REMOVE | i;
+						STREAM_Decode(&remove, &remove+1, deliver);
+					}
+				}
+			}
+			return;
+		}
+		++SDL_joystream.stats.calls;
+		SDL_joystream.stats.bytes += got;
+		SDL_joystream.len += got;
+
+		i = 0;
+		while ( i < SDL_joystream.len ) {
+			used = STREAM_Decode(SDL_joystream.buffer + i,
+			                     SDL_joystream.buffer + SDL_joystream.len,
+			                     deliver);
+			if ( used == 0 ) {
+				break;
+			}
+			i += used;
+		}
+		SDL_joystream.len -= i;
+		memmove(SDL_joystream.buffer, SDL_joystream.buffer + i, SDL_joystream.len);
+	}
+}
+
+/* Catch up with the exporter's descriptions of its joysticks.  Once one
+   of them is open, the stream is left to its updates, which deliver what
+   they read; reading here would lose those events. */
+static void STREAM_Describe(void)
+{
+	int i;
+
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		if ( SDL_joyopen[i] && (SDL_joylist[i].kind == JOYKIND_STREAM) ) {
+			return;
+		}
+	}
+	STREAM_Read(SDL_FALSE);
+}
+
+/* Open a joystick played back from the stream */
+static int STREAM_OpenJoystick(SDL_Joystick *joystick)
+{
+	struct joystream_pad *pad;
+
+	STREAM_Describe();
+
+	joystick->hwdata = (struct joystick_hwdata *)
+	                   malloc(sizeof(*joystick->hwdata));
+	if ( joystick->hwdata == NULL ) {
+		SDL_OutOfMemory();
+		return(-1);
+	}
+	memset(joystick->hwdata, 0, sizeof(*joystick->hwdata));
+	joystick->hwdata->fd = -1;
+
+	/* A joystick the exporter hasn't described yet is taken to be a pad */
+	pad = &SDL_joystream.pads[joystick->index];
+	if ( pad->present ) {
+		joystick->naxes = pad->naxes;
+		joystick->nbuttons = pad->nbuttons;
+		joystick->nhats = pad->nhats;
+	} else {
+		joystick->naxes = NUM_AXES;
+		joystick->nbuttons = NUM_BUTTONS;
+		joystick->nhats = 1;
+	}
+	joystick->nballs = 0;
+	joystick->nactuators = 0;
+	joystick->hwdata->remote_state.hat = SDL_HAT_CENTERED;
+	SDL_joyopen[joystick->index] = joystick;
+	return(0);
+}
+
+/* Function to scan the system for joysticks.
+   Every node is opened, in parallel, and the capability checks are only
+   made on event devices the capability cache doesn't know.  /dev/ps2padstat is not opened
+   until a pad is named or opened.
+ */
+int SDL_SYS_JoystickInit(void)
+{
+	/* The PS2 pad devices, one per port */
+	const char *ps2pad_devices[MAX_JOYSTICKS] = {
+		"/dev/ps2pad00",
+		"/dev/ps2pad10"
+	};
+	struct joyprobe *probes;
+	int nprobes;
+	int numjoysticks;
+	int i;
+	char path[PATH_MAX];
+
+	/* Use the joysticks another process publishes, instead of the devices */
+	if ( getenv("SDL_JOYSTICK_SHM") != NULL ) {
+		numjoysticks = SHM_Attach(getenv("SDL_JOYSTICK_SHM"));
+		for ( i=0; i<numjoysticks; ++i ) {
+			SDL_joylist[i].path = mystrdup(SDL_joyshm_name);
+			SDL_joylist[i].rdev = 0;
+			SDL_joylist[i].kind = JOYKIND_SHM;
+			SDL_joylist[i].port = i;
+		}
+		return(numjoysticks);
+	}
+
+	/* Or the joysticks another process streams to us */
+	if ( getenv("SDL_JOYSTICK_STREAM") != NULL ) {
+		if ( STREAM_Open(getenv("SDL_JOYSTICK_STREAM"), SDL_FALSE) < 0 ) {
+			return(-1);
+		}
+		for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+			SDL_joylist[i].path = mystrdup(getenv("SDL_JOYSTICK_STREAM"));
+			SDL_joylist[i].rdev = 0;
+			SDL_joylist[i].kind = JOYKIND_STREAM;
+			SDL_joylist[i].port = i;
+		}
+		return(MAX_JOYSTICKS);
+	}
+
+	probes = (struct joyprobe *)malloc(MAX_PROBE_NODES * sizeof(*probes));
+	if ( probes == NULL ) {
+		SDL_OutOfMemory();
+		return(-1);
+	}
+	nprobes = 0;
+
+	/* First see if the user specified a joystick to use */
+	if ( getenv("SDL_JOYSTICK_DEVICE") != NULL ) {
+		strncpy(path, getenv("SDL_JOYSTICK_DEVICE"), sizeof(path));
+		path[sizeof(path)-1] = '\0';
+		if ( JoystickAddProbe(probes, nprobes, path, JOYKIND_ANY) > 0 ) {
+			++nprobes;
+		}
+	}
+
+#ifdef USE_INPUT_EVENTS
+	for ( i=0; i < MAX_PROBE_NODES; ++i ) {
+		int n;
+
+		sprintf(path, "/dev/input/event%d", i);
+		n = JoystickAddProbe(probes, nprobes, path, JOYKIND_EVDEV);
+		if ( n < 0 ) {
+			break;
+		}
+		nprobes += n;
+	}
+#endif
+	for ( i=0; i < MAX_JOYSTICKS; ++i ) {
+		if ( JoystickAddProbe(probes, nprobes, ps2pad_devices[i], JOYKIND_PS2PAD) > 0 ) {
+			++nprobes;
+		}
+	}
+
+	JoyCacheLoad();
+	JoystickProbeAll(probes, nprobes);
+	if ( SDL_joycache_dirty ) {
+		JoyCacheSave();
+	}
+
+	JoyMapCompile();
+
+	SDL_joygroup = SDL_FALSE;
+	if ( getenv("SDL_JOYSTICK_GROUP_SAMPLING") &&
+	     (atoi(getenv("SDL_JOYSTICK_GROUP_SAMPLING")) != 0) ) {
+		SDL_joygroup = SDL_TRUE;
+	}
+	memset(&SDL_joysampling, 0, sizeof(SDL_joysampling));
+
+	SDL_joyfilter = SDL_FALSE;
+	SDL_joyfilter_params.min_cutoff = JOYFILTER_MIN_CUTOFF;
+	SDL_joyfilter_params.beta = JOYFILTER_BETA;
+	SDL_joyfilter_params.hysteresis = JOYFILTER_HYSTERESIS;
+	if ( getenv("SDL_JOYSTICK_AXIS_FILTER") &&
+	     (sscanf(getenv("SDL_JOYSTICK_AXIS_FILTER"), "%f %f %d",
+	             &SDL_joyfilter_params.min_cutoff,
+	             &SDL_joyfilter_params.beta,
+	             &SDL_joyfilter_params.hysteresis) >= 1) &&
+	     (SDL_joyfilter_params.min_cutoff > 0.0f) ) {
+		SDL_joyfilter = SDL_TRUE;
+	}
+
+	SDL_joygun.area[0] = JOYGUN_LEFT;
+	SDL_joygun.area[1] = JOYGUN_RIGHT;
+	SDL_joygun.area[2] = JOYGUN_TOP;
+	SDL_joygun.area[3] = JOYGUN_BOTTOM;
+	if ( getenv("SDL_JOYSTICK_GUN_AREA") &&
+	     ((sscanf(getenv("SDL_JOYSTICK_GUN_AREA"), "%d %d %d %d",
+	              &SDL_joygun.area[0], &SDL_joygun.area[1],
+	              &SDL_joygun.area[2], &SDL_joygun.area[3]) != 4) ||
+	      (SDL_joygun.area[0] < 0) || (SDL_joygun.area[2] < 0) ||
+	      (SDL_joygun.area[1] > 0xFFFF) || (SDL_joygun.area[3] > 0xFFFF) ||
+	      (SDL_joygun.area[1] <= SDL_joygun.area[0]) ||
+	      (SDL_joygun.area[3] <= SDL_joygun.area[2])) ) {
+		SDL_SetError("Invalid SDL_JOYSTICK_GUN_AREA, using NTSC\n");
+		SDL_joygun.area[0] = JOYGUN_LEFT;
+		SDL_joygun.area[1] = JOYGUN_RIGHT;
+		SDL_joygun.area[2] = JOYGUN_TOP;
+		SDL_joygun.area[3] = JOYGUN_BOTTOM;
+	}
+	SDL_joygun.period_us = 1000000 / JOYGUN_HZ;
+	if ( getenv("SDL_JOYSTICK_GUN_HZ") &&
+	     (atoi(getenv("SDL_JOYSTICK_GUN_HZ")) > 0) ) {
+		SDL_joygun.period_us = 1000000 / atoi(getenv("SDL_JOYSTICK_GUN_HZ"));
+	}
+	SDL_joygun.frame = 0;
+
+	/* Share the pads we open with other processes */
+	if ( getenv("SDL_JOYSTICK_STREAM_EXPORT") != NULL ) {
+		if ( STREAM_Open(getenv("SDL_JOYSTICK_STREAM_EXPORT"), SDL_TRUE) < 0 ) {
+			free(probes);
+			return(-1);
+		}
+	}
+	if ( getenv("SDL_JOYSTICK_SHM_PUBLISH") != NULL ) {
+		SHM_Publish(getenv("SDL_JOYSTICK_SHM_PUBLISH"));
+	}
+
+	/* We're fine, add the joysticks in the order they were found */
+	numjoysticks = 0;
+	for ( i=0; i<nprobes; ++i ) {
+		if ( (probes[i].kind != JOYKIND_NONE) &&
+		     (numjoysticks < MAX_JOYSTICKS) ) {
+			SDL_joylist[numjoysticks].path = probes[i].path;
+			SDL_joylist[numjoysticks].rdev = probes[i].sb.st_rdev;
+			SDL_joylist[numjoysticks].kind = probes[i].kind;
+			SDL_joylist[numjoysticks].port = 0;
+			if ( probes[i].kind == JOYKIND_PS2PAD ) {
+				/* The nodes are named ps2pad<port><slot> */
+				const char *base = strrchr(probes[i].path, '/');
+				sscanf(base ? base+1 : probes[i].path, "ps2pad%1d",
+				       &SDL_joylist[numjoysticks].port);
+			}
+			++numjoysticks;
+		} else {
+			free(probes[i].path);
+		}
+	}
+	free(probes);
+
+	return(numjoysticks);
+}
+
+/* Read the status of every PS2 pad port, opening /dev/ps2padstat on first use */
+static int JS_ReadPortStatus(struct ps2pad_stat *status, int maxlen)
+{
+	memset(status, 0, maxlen);
+	if ( ps2padstat_fd < 0 ) {
+		ps2padstat_fd = open("/dev/ps2padstat", O_RDONLY | O_NONBLOCK);
+		if ( ps2padstat_fd < 0 ) {
+			SDL_SetError("Unable to open /dev/ps2padstat\n");
+			return(-1);
+		}
+	}
+	if ( read(ps2padstat_fd, status, maxlen) < 0 ) {
+		SDL_SetError("Unable to read /dev/ps2padstat\n");
+		return(-1);
+	}
+	return(0);
+}
+/* Function to get the device-dependent name of a joystick */
+const char *SDL_SYS_JoystickName(int index)
+{
+	static char name[MAX_JOYSTICKS][128];
+	const char *type_name;
+	struct ps2pad_stat joystick_port_status[MAX_JOYSTICKS];
+	int joystick_type;
+	int i;
+
+	if ( SDL_joylist[index].kind == JOYKIND_SHM ) {
+		struct joyshm_pad pad;
+
+		SHM_ReadPad(SDL_joylist[index].port, &pad);
+		strcpy(name[index], pad.present ? pad.name : "Not connected");
+		return(name[index]);
+	}
+	if ( SDL_joylist[index].kind == JOYKIND_STREAM ) {
+		STREAM_Describe();
+		strcpy(name[index], SDL_joystream.pads[index].present ?
+			SDL_joystream.pads[index].name : "Not connected");
+		return(name[index]);
+	}
+
+	JS_ReadPortStatus(joystick_port_status, sizeof(joystick_port_status));
+
+	joystick_type = PS2PAD_TYPE(joystick_port_status[SDL_joylist[index].port].type);
+
+	type_name = "Not connected";
+	for ( i=0; i<(int)(sizeof(ps2pad_names)/sizeof(ps2pad_names[0])); ++i ) {
+		if ( ps2pad_names[i].type == joystick_type ) {
+			type_name = ps2pad_names[i].name;
+		}
+	}
+	sprintf(name[index], "port %d:  %s (type: %d)",
+		joystick_port_status[SDL_joylist[index].port].portslot>>4,
+		type_name, joystick_type);
+
+	return(name[index]);
+}
+
+static int allocate_hatdata(SDL_Joystick *joystick)
+{
+	int i;
+
+	joystick->hwdata->hats = (struct hwdata_hat *)malloc(
+		joystick->nhats * sizeof(struct hwdata_hat));
+	if ( joystick->hwdata->hats == NULL ) {
+		return(-1);
+	}
+	for ( i=0; i<joystick->nhats; ++i ) {
+		joystick->hwdata->hats[i].axis[0] = 1;
+		joystick->hwdata->hats[i].axis[1] = 1;
+	}
+	return(0);
+}
+
+static int allocate_balldata(SDL_Joystick *joystick)
+{
+	int i;
+
+	joystick->hwdata->balls = (struct hwdata_ball *)malloc(
+		joystick->nballs * sizeof(struct hwdata_ball));
+	if ( joystick->hwdata->balls == NULL ) {
+		return(-1);
+	}
+	for ( i=0; i<joystick->nballs; ++i ) {
+		joystick->hwdata->balls[i].axis[0] = 0;
+		joystick->hwdata->balls[i].axis[1] = 0;
+	}
+	return(0);
+}
+
+/* The jitter filter.
+   A 1 Euro filter (Casiez et al.) on each axis: a low pass whose cutoff
+   rises with the filtered speed of the stick, so a stick at rest is
+   smoothed heavily and a moving one hardly lags.  A new position is only
+   sent when the filtered value has moved by the hysteresis since the last
+   one, or has settled on the position read.
+ */
+#define JOYFILTER_SPEED_CUTOFF	1.0f	/* Hz, for the speed estimate */
+#define JOYFILTER_SNAP		(1.0f/1024)	/* Close enough to settle */
+#define JOYFILTER_TWO_PI	6.2831853f
+
+static __inline__ float JoyFilterAlpha(float cutoff, float dt)
+{
+	float rc_inverse;
+
+	rc_inverse = JOYFILTER_TWO_PI * cutoff * dt;
+	return(rc_inverse / (rc_inverse + 1.0f));
+}
+
+/* Run a new position of an axis through the filter at time timestamp.
+   Returns SDL_TRUE with the position to send in *value, or SDL_FALSE if
+   nothing should be sent.
+ */
+static SDL_bool FilterAxis(SDL_Joystick *joystick, int axis, int *value, Uint32 timestamp)
+{
+	struct joystick_hwdata *hwdata;
+	struct axis_filter *filter;
+	float position;
+	float speed;
+	float dt;
+	float delta;
+	int delivered;
+
+	hwdata = joystick->hwdata;
+	filter = &hwdata->filter[axis];
+	position = *value / 32768.0f;
+
+	if ( !filter->primed ) {
+		filter->primed = SDL_TRUE;
+		filter->value = position;
+		filter->speed = 0.0f;
+		filter->raw = *value;
+		filter->delivered = *value;
+		filter->time = timestamp;
+		++hwdata->filter_stats.changes;
+		++hwdata->filter_stats.delivered;
+		return(SDL_TRUE);
+	}
+	if ( *value != filter->raw ) {
+		filter->raw = *value;
+		++hwdata->filter_stats.changes;
+	}
+
+	/* Reports read in the same tick are taken to be a tick apart */
+	dt = (timestamp - filter->time) * 0.001f;
+	if ( dt < 0.001f ) {
+		dt = 0.001f;
+	}
+	filter->time = timestamp;
+
+	speed = (position - filter->value) / dt;
+	filter->speed += JoyFilterAlpha(JOYFILTER_SPEED_CUTOFF, dt) * (speed - filter->speed);
+	speed = (filter->speed < 0.0f) ? -filter->speed : filter->speed;
+	filter->value += JoyFilterAlpha(hwdata->filter_params.min_cutoff +
+	                                 hwdata->filter_params.beta * speed, dt) *
+	                 (position - filter->value);
+
+	delta = filter->value - position;
+	if ( (delta < JOYFILTER_SNAP) && (delta > -JOYFILTER_SNAP) ) {
+		/* Caught up with the stick */
+		hwdata->filter_unsettled &= ~(1 << axis);
+		delivered = *value;
+		if ( delivered == filter->delivered ) {
+			return(SDL_FALSE);
+		}
+	} else {
+		hwdata->filter_unsettled |= (1 << axis);
+		delivered = (int)(filter->value * 32768.0f +
+		                  ((filter->value < 0.0f) ? -0.5f : 0.5f));
+		if ( delivered > 32767 ) {
+			delivered = 32767;
+		} else if ( delivered < -32768 ) {
+			delivered = -32768;
+		}
+		if ( (delivered - filter->delivered < hwdata->filter_params.hysteresis) &&
+		     (filter->delivered - delivered < hwdata->filter_params.hysteresis) ) {
+			return(SDL_FALSE);
+		}
+	}
+	filter->delivered = delivered;
+	*value = delivered;
+	++hwdata->filter_stats.delivered;
+	return(SDL_TRUE);
+}
+
+/* Decode one pad data report into joystick events.
+   This is the template for the routines bound to hwdata->decode at open.
+   Each passes constant tables and counts, so the compiler unrolls the
+   loops with the buffer offsets fixed and drops whatever its pad type
+   does not have.  With filter set every axis goes through FilterAxis()
+   on every report, changed or not, so that it can settle.
+ */
+static __inline__ void JS_DecodeReport(SDL_Joystick *joystick,
+		const Uint8 *joystick_buffer,
+		const Uint32 *button_mask, int nbuttons,
+		const int *axis_offset, int naxes, Uint8 axis_invert, int nhats,
+		SDL_bool filter)
+{
+	Uint32 joystick_buttons;
+	Uint32 joystick_buttons_xor;
+	int hat_event_temp;
+	int button_loop;
+	int axis_loop;
+	int offset;
+	int value;
+
+	joystick_buttons = ~(((unsigned long)joystick_buffer[0] << 24)
+		| ((unsigned long)joystick_buffer[1] << 16)
+		| ((unsigned long)joystick_buffer[2] << 8)
+		| (joystick_buffer[3] << 0));
+
+	/* Evaluate the button states that have changed since the last update.
+	   Only send updates for changes in in the joystick state! */
+	joystick_buttons_xor = joystick_buttons ^ joystick->hwdata->old_joystick_buttons;
+
+	/* Check if there is a change in the joystick hat (Direction pad) */
+	if((nhats > 0) && (joystick_buttons_xor & (PS2PAD_BUTTON_LEFT | PS2PAD_BUTTON_RIGHT | PS2PAD_BUTTON_UP | PS2PAD_BUTTON_DOWN)))
+	{
+		hat_event_temp = SDL_HAT_CENTERED;
+		if(joystick_buttons & PS2PAD_BUTTON_LEFT)	hat_event_temp |= SDL_HAT_LEFT;
+		if(joystick_buttons & PS2PAD_BUTTON_RIGHT)	hat_event_temp |= SDL_HAT_RIGHT;
+		if(joystick_buttons & PS2PAD_BUTTON_UP)	hat_event_temp |= SDL_HAT_UP;
+		if(joystick_buttons & PS2PAD_BUTTON_DOWN)	hat_event_temp |= SDL_HAT_DOWN;
+		SDL_PrivateJoystickHat(joystick, 0, hat_event_temp);
+	}
+
+	/* Check each remaining button and send a button event if it has changed */
+	for(button_loop = 0; button_loop < nbuttons; button_loop++)
+	{
+		if(joystick_buttons_xor & button_mask[button_loop])
+		{
+			SDL_PrivateJoystickButton(joystick, button_loop, (joystick_buttons & button_mask[button_loop]) ? SDL_PRESSED : SDL_RELEASED);
+		}
+	}
+
+	joystick->hwdata->old_joystick_buttons = joystick_buttons;
+
+	/* Normalise joystick axes into within the -32767 -> +32767 range.
+	   
+	   The 2 analog sticks (2 axes each) are read in the same order as
+	   the Linux JS module. (left == 0,1, right == 2,3).
+	   
+	   If the axis value has not changed do not send the same value as
+	   though there has been a change.
+	   
+	   When the joystick is first updated by SDL_EventPoll() the
+	   old_joystick_buffer is all 0, this has the desired effect of new
+	   events for each axis and to be sent
+	*/
+	for(axis_loop = 0; axis_loop < naxes; axis_loop++)
+	{
+		/* Do not send axis events when there is no change */
+		offset = axis_offset[axis_loop];
+		if(filter)
+		{
+			value = (joystick_buffer[offset] << 8) - 32768;
+			if(axis_invert & (1 << axis_loop))
+			{
+				value = -1 - value;
+			}
+			if(FilterAxis(joystick, axis_loop, &value, joystick->hwdata->report_time))
+			{
+				SDL_PrivateJoystickAxis(joystick, axis_loop, value);
+			}
+		}
+		else if(joystick_buffer[offset] != joystick->hwdata->old_joystick_buffer[offset])
+		{
+			value = (joystick_buffer[offset] << 8) - 32768;
+			if(axis_invert & (1 << axis_loop))
+			{
+				value = -1 - value;
+			}
+			SDL_PrivateJoystickAxis(joystick, axis_loop, value);
+		}
+	}
+}
+
+/* Plain digital pads, and pads only supported as one (Nejicon, unknown) */
+static void JS_DecodeDigital(SDL_Joystick *joystick, const Uint8 *joystick_buffer)
+{
+	JS_DecodeReport(joystick, joystick_buffer,
+		ps2pad_buttons, NUM_BUTTONS, ps2pad_axes, 0, 0, 1, SDL_FALSE);
+}
+
+/* Analog and DualShock 1/2 pads, which report the same data */
+static void JS_DecodeAnalog(SDL_Joystick *joystick, const Uint8 *joystick_buffer)
+{
+	JS_DecodeReport(joystick, joystick_buffer,
+		ps2pad_buttons, NUM_BUTTONS, ps2pad_axes, NUM_AXES, 0, 1, SDL_FALSE);
+}
+
+/* Any pad with a controller mapping applied, see SDL_joymap */
+static void JS_DecodeMapped(SDL_Joystick *joystick, const Uint8 *joystick_buffer)
+{
+	JS_DecodeReport(joystick, joystick_buffer,
+		joystick->hwdata->button_mask, joystick->nbuttons,
+		joystick->hwdata->axis_offset, joystick->naxes,
+		joystick->hwdata->axis_invert, joystick->nhats, SDL_FALSE);
+}
+
+/* Any pad with the jitter filter on, see SDL_JoystickSetAxisFilter() */
+static void JS_DecodeFiltered(SDL_Joystick *joystick, const Uint8 *joystick_buffer)
+{
+	JS_DecodeReport(joystick, joystick_buffer,
+		joystick->hwdata->button_mask, joystick->nbuttons,
+		joystick->hwdata->axis_offset, joystick->naxes,
+		joystick->hwdata->axis_invert, joystick->nhats, SDL_TRUE);
+}
+
+/* Scale a light gun position, between the edges lo and hi, to an axis.
+   The edges are 16 bit, like the positions, so the product fits a Uint32.
+ */
+static __inline__ int GunAxis(int position, int lo, int hi)
+{
+	if ( position < lo ) {
+		position = lo;
+	} else if ( position > hi ) {
+		position = hi;
+	}
+	return((int)(((Uint32)(position - lo) * 65535u) / (Uint32)(hi - lo)) - 32768);
+}
+
+/* The Namco G-Con 45.  Bytes 4 and 5 of its report are where it points
+   across the picture, and 6 and 7 down it, both little endian.  The gun
+   reports 1,10 when it sees no light, and 0,5 when it can't time the
+   picture; either way it is off the screen, which is the last button,
+   and the axes keep the last position on it.  The position is scaled to
+   the edges in SDL_joygun.area, and each report is kept, with when it was
+   read, for SDL_JoystickGetGunSample().
+ */
+static void JS_DecodeGun(SDL_Joystick *joystick, const Uint8 *joystick_buffer)
+{
+	struct joystick_hwdata *hwdata;
+	SDL_JoystickGunSample *sample;
+	Uint8 onscreen;
+	int value;
+	int i;
+
+	hwdata = joystick->hwdata;
+	JS_DecodeReport(joystick, joystick_buffer,
+		hwdata->button_mask, joystick->nbuttons-1, ps2pad_axes, 0, 0, 0, SDL_FALSE);
+
+	sample = &hwdata->gun_sample;
+	sample->frame = hwdata->gun_frame;
+	sample->timestamp = hwdata->report_time;
+	sample->timestamp_us = hwdata->gun_time_us;
+	sample->x = joystick_buffer[4] | (joystick_buffer[5] << 8);
+	sample->y = joystick_buffer[6] | (joystick_buffer[7] << 8);
+	sample->buttons = 0;
+	for ( i=0; i<joystick->nbuttons-1; ++i ) {
+		if ( hwdata->old_joystick_buttons & hwdata->button_mask[i] ) {
+			sample->buttons |= (1 << i);
+		}
+	}
+
+	onscreen = !((sample->x <= 1) && (sample->y <= 10));
+	if ( onscreen != sample->onscreen ) {
+		sample->onscreen = onscreen;
+		SDL_PrivateJoystickButton(joystick, joystick->nbuttons-1,
+		                          onscreen ? SDL_RELEASED : SDL_PRESSED);
+	}
+	if ( onscreen ) {
+		value = GunAxis(sample->x, SDL_joygun.area[0], SDL_joygun.area[1]);
+		if ( value != sample->axis[0] ) {
+			sample->axis[0] = value;
+			SDL_PrivateJoystickAxis(joystick, 0, value);
+		}
+		value = GunAxis(sample->y, SDL_joygun.area[2], SDL_joygun.area[3]);
+		if ( value != sample->axis[1] ) {
+			sample->axis[1] = value;
+			SDL_PrivateJoystickAxis(joystick, 1, value);
+		}
+	} else {
+		sample->buttons |= (1 << (joystick->nbuttons-1));
+	}
+}
+
+static SDL_bool JS_ConfigJoystick(SDL_Joystick *joystick, int fd)
+{
+	SDL_bool handled;
+	const struct joymap *map;
+	struct ps2pad_stat joystick_port_status[MAX_JOYSTICKS];
+	struct ps2pad_act actuator_align;
+	int joystick_type;
+	int index;
+	int i;
+
+	handled = SDL_FALSE;
+	joystick_type = -1;
+	index = SDL_joylist[joystick->index].port;
+
+	JS_ReadPortStatus(joystick_port_status, sizeof(joystick_port_status));
+
+	joystick_type = PS2PAD_TYPE(joystick_port_status[index].type);
 
 	switch(joystick_type)
 	{
-		case PS2PAD_TYPE_DUALSHOCK:
+		case PS2PAD_TYPE_DUALSHOCK:
+		{
+			joystick->naxes = 4;
+			joystick->nbuttons = 12;
+			joystick->nballs = 0;
+			joystick->nhats = 1;
+			joystick->nactuators = 2;
+
+			/* allign actuators */
+			memset(&actuator_align, 0xFF, sizeof(actuator_align.data));
+			actuator_align.len = 6;
+			actuator_align.data[0] = 0;
+			actuator_align.data[1] = 1;
+			ioctl(joystick->hwdata->fd, PS2PAD_IOCSETACTALIGN, &actuator_align);
+
+			joystick->hwdata->joystick_type = joystick_type;
+			handled = SDL_TRUE;
+			break;
+		}
+		case PS2PAD_TYPE_DIGITAL:
+		{
+			joystick->naxes = 0;
+			joystick->nbuttons = 12;
+			joystick->nballs = 0;
+			joystick->nhats = 1;
+			joystick->nactuators = 0;
+
+			joystick->hwdata->joystick_type = joystick_type;
+			handled = SDL_TRUE;
+			break;
+		}
+		case PS2PAD_TYPE_ANALOG:
+		{
+			joystick->naxes = 4;
+			joystick->nbuttons = 12;
+			joystick->nballs = 0;
+			joystick->nhats = 1;
+			joystick->nactuators = 0;
+
+			joystick->hwdata->joystick_type = joystick_type;
+			handled = SDL_TRUE;
+			break;
+		}
+		/* TODO Specifics of this pad are unknown, using as plain digital */
+		case PS2PAD_TYPE_NEJICON:
+		{
+			joystick->naxes = 0;
+			joystick->nbuttons = 12;
+			joystick->nballs = 0;
+			joystick->nhats = 1;
+			joystick->nactuators = 0;
+
+			joystick->hwdata->joystick_type = joystick_type;
+			handled = SDL_TRUE;
+			break;
+		}
+		case PS2PAD_TYPE_NAMCOGUN:
+		{
+			/* Namco G-Con 45 light gun, with off screen as a button */
+			joystick->naxes = 2;
+			joystick->nbuttons = NUM_GUN_BUTTONS + 1;
+			joystick->nballs = 0;
+			joystick->nhats = 0;
+			joystick->nactuators = 0;
+
+			joystick->hwdata->joystick_type = joystick_type;
+			joystick->hwdata->gun = SDL_TRUE;
+			joystick->hwdata->gun_sample.onscreen = SDL_TRUE;
+			handled = SDL_TRUE;
+			break;
+		}
+		default:
+		{
+			/* Support currently unknown controlers in plain digital button mode */
+			SDL_SetError("Unsupported PS2 pad type %d, trying to use as a plain digital pad\n", joystick_type);
+			joystick->naxes = 0;
+			joystick->nbuttons = 12;
+			joystick->nballs = 0;
+			joystick->nhats = 1;
+			joystick->nactuators = 0;
+
+			joystick->hwdata->joystick_type = 0;
+			handled = SDL_TRUE;
+			break;
+		}
+	}
+
+
+	/* Start from the pad's own layout */
+	for ( i=0; i<NUM_BUTTONS; ++i ) {
+		joystick->hwdata->button_mask[i] = ps2pad_buttons[i];
+	}
+	if ( joystick->hwdata->gun ) {
+		for ( i=0; i<NUM_GUN_BUTTONS; ++i ) {
+			joystick->hwdata->button_mask[i] = ps2pad_gun_buttons[i];
+		}
+	}
+	for ( i=0; i<NUM_AXES; ++i ) {
+		joystick->hwdata->axis_offset[i] = ps2pad_axes[i];
+	}
+	for ( i=0; i<MAX_ACTUATORS; ++i ) {
+		joystick->hwdata->actuator_map[i] = i;
+	}
+	joystick->hwdata->axis_invert = 0;
+
+	/* Apply the controller mapping for this port and pad type */
+	map = &SDL_joymap[index][joystick_type & (JOYMAP_TYPES-1)];
+	if ( map->fields & JOYMAP_BUTTONS ) {
+		joystick->nbuttons = map->nbuttons;
+		for ( i=0; i<map->nbuttons; ++i ) {
+			joystick->hwdata->button_mask[i] = ps2pad_buttons[map->buttons[i]];
+		}
+		if ( joystick->hwdata->gun ) {
+			++joystick->nbuttons;
+		}
+	}
+	if ( (map->fields & JOYMAP_AXES) && (joystick->naxes > 0) &&
+	     !joystick->hwdata->gun ) {
+		joystick->naxes = (map->naxes < NUM_AXES) ? map->naxes : NUM_AXES;
+		for ( i=0; i<joystick->naxes; ++i ) {
+			joystick->hwdata->axis_offset[i] = ps2pad_axes[map->axes[i]];
+		}
+		joystick->hwdata->axis_invert = map->axis_invert;
+	}
+	if ( map->fields & JOYMAP_HATS ) {
+		joystick->nhats = (map->nhats > 0);
+	}
+	if ( map->fields & JOYMAP_BALLS ) {
+		joystick->nballs = map->nballs;
+	}
+	if ( (map->fields & JOYMAP_ACTUATORS) && (joystick->nactuators > 0) ) {
+		joystick->nactuators = map->nactuators;
+		for ( i=0; i<map->nactuators; ++i ) {
+			joystick->hwdata->actuator_map[i] = map->actuators[i];
+		}
+	}
+
+	/* Bind the decode routine for this pad type */
+	if ( joystick->hwdata->gun ) {
+		joystick->hwdata->decode = JS_DecodeGun;
+	} else if ( map->fields ) {
+		joystick->hwdata->decode = JS_DecodeMapped;
+	} else if ( (joystick->hwdata->joystick_type == PS2PAD_TYPE_DUALSHOCK) ||
+	            (joystick->hwdata->joystick_type == PS2PAD_TYPE_ANALOG) ) {
+		joystick->hwdata->decode = JS_DecodeAnalog;
+	} else {
+		joystick->hwdata->decode = JS_DecodeDigital;
+	}
+
+	/* Describe the actuator propeties */
+	if ( joystick->nactuators > 0 ) {
+		joystick->actuators = (struct actuator_info *)
+				malloc(joystick->nactuators * sizeof(*joystick->actuators));
+		if ( joystick->actuators ) {
+			memset(joystick->actuators, 0, joystick->nactuators*sizeof(*joystick->actuators));
+			for ( i=0; i<joystick->nactuators; ++i ) {
+				joystick->actuators[i].range =
+					ps2pad_actuators[joystick->hwdata->actuator_map[i]].range;
+				joystick->actuators[i].type =
+					ps2pad_actuators[joystick->hwdata->actuator_map[i]].type;
+			}
+		}
+	}
+
+	/* Remap hats and balls */
+	if (handled) {
+		if ( joystick->nhats > 0 ) {
+			if ( allocate_hatdata(joystick) < 0 ) {
+				joystick->nhats = 0;
+			}
+		}
+		if ( joystick->nballs > 0 ) {
+			if ( allocate_balldata(joystick) < 0 ) {
+				joystick->nballs = 0;
+			}
+		}
+	}
+	return(handled);
+}
+
+#ifdef USE_INPUT_EVENTS
+
+/* Expose FF_RUMBLE motors, or failing that an FF_PERIODIC effect, as actuators */
+static void EV_ConfigActuators(SDL_Joystick *joystick, int fd)
+{
+	unsigned long ffbit[4];
+	struct joystick_hwdata *hwdata;
+	int i;
+
+	hwdata = joystick->hwdata;
+	hwdata->ff_type = 0;
+	hwdata->ff_effect.id = -1;
+	if ( ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffbit)), ffbit) < 0 ) {
+		return;
+	}
+	if ( test_bit(FF_RUMBLE, ffbit) ) {
+		/* Small (weak) motor first, as on the DualShock */
+		hwdata->ff_type = FF_RUMBLE;
+		joystick->nactuators = 2;
+	} else if ( test_bit(FF_PERIODIC, ffbit) && test_bit(FF_SINE, ffbit) ) {
+		hwdata->ff_type = FF_PERIODIC;
+		joystick->nactuators = 1;
+	} else {
+		return;
+	}
+#ifdef DEBUG_INPUT_EVENTS
+	printf("Joystick has %d force feedback actuators\n", joystick->nactuators);
+#endif
+
+	joystick->actuators = (struct actuator_info *)
+			malloc(joystick->nactuators * sizeof(*joystick->actuators));
+	if ( joystick->actuators ) {
+		memset(joystick->actuators, 0, joystick->nactuators*sizeof(*joystick->actuators));
+		for ( i=0; i<joystick->nactuators; ++i ) {
+			joystick->actuators[i].range = 255;
+			joystick->actuators[i].type = i;
+			hwdata->actuator_map[i] = i;
+		}
+		if ( hwdata->ff_type == FF_PERIODIC ) {
+			joystick->actuators[0].type = 1;
+		}
+	}
+
+	/* Infinite length, played until it is stopped */
+	hwdata->ff_effect.type = hwdata->ff_type;
+	hwdata->ff_effect.replay.length = 0;
+	hwdata->ff_effect.replay.delay = 0;
+	if ( hwdata->ff_type == FF_PERIODIC ) {
+		hwdata->ff_effect.u.periodic.waveform = FF_SINE;
+		hwdata->ff_effect.u.periodic.period = 50;	/* ms */
+	}
+}
+
+static SDL_bool EV_ConfigJoystick(SDL_Joystick *joystick, int fd)
+{
+	int i;
+	unsigned long keybit[40];
+	unsigned long absbit[40];
+	unsigned long relbit[40];
+
+	/* See if this device uses the new unified event API */
+	if ( (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keybit)), keybit) >= 0) &&
+	     (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absbit)), absbit) >= 0) &&
+	     (ioctl(fd, EVIOCGBIT(EV_REL, sizeof(relbit)), relbit) >= 0) ) {
+		joystick->hwdata->is_hid = SDL_TRUE;
+
+		/* Get the number of buttons, axes, and other thingamajigs */
+		for ( i=BTN_JOYSTICK; i < KEY_MAX; ++i ) {
+			if ( test_bit(i, keybit) ) {
+#ifdef DEBUG_INPUT_EVENTS
+				printf("Joystick has button: 0x%x\n", i);
+#endif
+				joystick->hwdata->key_map[i-BTN_MISC] =
+						joystick->nbuttons;
+				++joystick->nbuttons;
+			}
+		}
+		for ( i=BTN_MISC; i < BTN_JOYSTICK; ++i ) {
+			if ( test_bit(i, keybit) ) {
+#ifdef DEBUG_INPUT_EVENTS
+				printf("Joystick has button: 0x%x\n", i);
+#endif
+				joystick->hwdata->key_map[i-BTN_MISC] =
+						joystick->nbuttons;
+				++joystick->nbuttons;
+			}
+		}
+		for ( i=0; i<ABS_MAX; ++i ) {
+			/* Skip hats */
+			if ( i == ABS_HAT0X ) {
+				i = ABS_HAT3Y;
+				continue;
+			}
+			if ( test_bit(i, absbit) ) {
+				int values[5];
+
+				ioctl(fd, EVIOCGABS(i), values);
+#ifdef DEBUG_INPUT_EVENTS
+				printf("Joystick has absolute axis: %x\n", i);
+				printf("Values = { %d, %d, %d, %d, %d }\n",
+					values[0], values[1],
+					values[2], values[3], values[4]);
+#endif /* DEBUG_INPUT_EVENTS */
+				joystick->hwdata->abs_map[i] = joystick->naxes;
+				if ( values[1] == values[2] ) {
+				    joystick->hwdata->abs_correct[i].used = 0;
+				} else {
+				    joystick->hwdata->abs_correct[i].used = 1;
+				    joystick->hwdata->abs_correct[i].coef[0] =
+					(values[2] + values[1]) / 2 - values[4];
+				    joystick->hwdata->abs_correct[i].coef[1] =
+					(values[2] + values[1]) / 2 + values[4];
+				    joystick->hwdata->abs_correct[i].coef[2] =
+					(1 << 29) / ((values[2] - values[1]) / 2 - 2 * values[4]);
+				}
+				++joystick->naxes;
+			}
+		}
+		for ( i=ABS_HAT0X; i <= ABS_HAT3Y; i += 2 ) {
+			if ( test_bit(i, absbit) || test_bit(i+1, absbit) ) {
+#ifdef DEBUG_INPUT_EVENTS
+				printf("Joystick has hat %d\n",(i-ABS_HAT0X)/2);
+#endif
+				++joystick->nhats;
+			}
+		}
+		if ( test_bit(REL_X, relbit) || test_bit(REL_Y, relbit) ) {
+			++joystick->nballs;
+		}
+
+		/* Allocate data to keep track of these thingamajigs */
+		if ( joystick->nhats > 0 ) {
+			if ( allocate_hatdata(joystick) < 0 ) {
+				joystick->nhats = 0;
+			}
+		}
+		if ( joystick->nballs > 0 ) {
+			if ( allocate_balldata(joystick) < 0 ) {
+				joystick->nballs = 0;
+			}
+		}
+
+		EV_ConfigActuators(joystick, fd);
+	}
+	return(joystick->hwdata->is_hid);
+}
+
+#endif /* USE_INPUT_EVENTS */
+
+/* Function to open a joystick for use.
+   The joystick to open is specified by the index field of the joystick.
+   This should fill the nbuttons and naxes fields of the joystick structure.
+   It returns 0, or -1 if there is an error.
+ */
+int SDL_SYS_JoystickOpen(SDL_Joystick *joystick)
+{
+	int fd;
+	int joystick_stat;
+
+	if ( SDL_joylist[joystick->index].kind == JOYKIND_SHM ) {
+		return(SHM_OpenJoystick(joystick));
+	}
+	if ( SDL_joylist[joystick->index].kind == JOYKIND_STREAM ) {
+		return(STREAM_OpenJoystick(joystick));
+	}
+
+	/* Open the joystick and set the joystick file descriptor.
+	   Event devices are written to for force feedback, if allowed. */
+	fd = -1;
+	if ( SDL_joylist[joystick->index].kind == JOYKIND_EVDEV ) {
+		fd = open(SDL_joylist[joystick->index].path, O_RDWR, 0);
+	}
+	if ( fd < 0 ) {
+		fd = open(SDL_joylist[joystick->index].path, O_RDONLY, 0);
+	}
+	if ( fd < 0 ) {
+		SDL_SetError("Unable to open %s\n",
+		             SDL_joylist[joystick->index].path);
+		return(-1);
+	}
+
+	/* Check if the joystick is available for use */
+	joystick_stat = PS2PAD_STAT_READY;
+	if ( SDL_joylist[joystick->index].kind == JOYKIND_PS2PAD ) {
+		ioctl(fd, PS2PAD_IOCGETSTAT, &joystick_stat);
+	}
+	switch(joystick_stat)
+	{
+		case PS2PAD_STAT_NOTCON:
+		{
+			SDL_SetError("No device connected to %s\n",
+		             SDL_joylist[joystick->index].path);
+			return(-1);
+		}
+		case PS2PAD_STAT_BUSY:
+		{
+			/* TODO Possibly wait for a certain time to allow for delays */
+			SDL_SetError("Busy device connected to %s\n",
+		             SDL_joylist[joystick->index].path);
+			return(-1);
+		}
+		case PS2PAD_STAT_READY:
+		{
+			/* Joystick is ready for action! */
+			break;
+		}
+		case PS2PAD_STAT_ERROR:
+		{
+			SDL_SetError("Error on device connected to %s\n",
+		             SDL_joylist[joystick->index].path);
+			return(-1);
+		}
+		default:
+		{
+			SDL_SetError("Unknown status on device connected to %s\n",
+		             SDL_joylist[joystick->index].path);
+			return(-1);
+		}
+	}
+
+	joystick->hwdata = (struct joystick_hwdata *)
+	                   malloc(sizeof(*joystick->hwdata));
+	if ( joystick->hwdata == NULL ) {
+		SDL_OutOfMemory();
+		close(fd);
+		return(-1);
+	}
+	
+	/* Wipe clean the hwdata struct, including joystick buffers */
+	memset(joystick->hwdata, 0, sizeof(*joystick->hwdata));
+
+	joystick->hwdata->fd = fd;
+	SDL_joyopen[joystick->index] = joystick;
+
+	/* Set the joystick to non-blocking read mode */
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	/* Get the number of buttons and axes on the joystick */
+#ifdef USE_INPUT_EVENTS
+	if ( ! EV_ConfigJoystick(joystick, fd) )
+#endif
+		JS_ConfigJoystick(joystick, fd);
+
+	if ( SDL_joyshm_owner ) {
+		SHM_PublishPad(joystick, SDL_TRUE);
+	}
+	if ( SDL_joystream.export ) {
+		STREAM_ExportPad(joystick, SDL_TRUE);
+	}
+	if ( SDL_joyfilter && (joystick->naxes > 0) && !joystick->hwdata->gun ) {
+		SDL_JoystickSetAxisFilter(joystick, &SDL_joyfilter_params);
+	}
+
+	return(0);
+}
+
+static __inline__
+void HandleHat(SDL_Joystick *stick, Uint8 hat, int axis, int value)
+{
+	struct hwdata_hat *the_hat;
+	const Uint8 position_map[3][3] = {
+		{ SDL_HAT_LEFTUP, SDL_HAT_UP, SDL_HAT_RIGHTUP },
+		{ SDL_HAT_LEFT, SDL_HAT_CENTERED, SDL_HAT_RIGHT },
+		{ SDL_HAT_LEFTDOWN, SDL_HAT_DOWN, SDL_HAT_RIGHTDOWN }
+	};
+
+	the_hat = &stick->hwdata->hats[hat];
+	if ( value < 0 ) {
+		value = 0;
+	} else
+	if ( value == 0 ) {
+		value = 1;
+	} else
+	if ( value > 0 ) {
+		value = 2;
+	}
+	if ( value != the_hat->axis[axis] ) {
+		the_hat->axis[axis] = value;
+		SDL_PrivateJoystickHat(stick, hat,
+			position_map[the_hat->axis[1]][the_hat->axis[0]]);
+	}
+}
+
+static __inline__
+void HandleBall(SDL_Joystick *stick, Uint8 ball, int axis, int value)
+{
+	stick->hwdata->balls[ball].axis[axis] += value;
+}
+
+/* Hand the changes between two history frames to the frame callback,
+   and post them as one frame event */
+static void DeliverFrame(SDL_Joystick *stick,
+                         const struct joyframe *prev, const struct joyframe *frame)
+{
+	SDL_JoyFrameEvent delta;
+	SDL_Event event;
+	int i;
+
+	delta.which = stick->index;
+	delta.timestamp = frame->timestamp;
+	delta.buttons = frame->buttons;
+	delta.changed_buttons = frame->buttons ^ prev->buttons;
+	delta.hat = frame->hat;
+	delta.hat_changed = (frame->hat != prev->hat);
+	delta.changed_axes = 0;
+	for ( i=0; i < HISTORY_AXES; ++i ) {
+		delta.axes[i] = frame->axes[i];
+		if ( (i < stick->naxes) && (frame->axes[i] != prev->axes[i]) ) {
+			delta.changed_axes |= (1 << i);
+		}
+	}
+	if ( !delta.changed_buttons && !delta.changed_axes && !delta.hat_changed ) {
+		return;
+	}
+
+	if ( stick->hwdata->frame_callback ) {
+		stick->hwdata->frame_callback(&delta, stick->hwdata->frame_userdata);
+	}
+
+	if ( SDL_joyframe_type ) {
+		i = SDL_joyframe_count[stick->index]++ & (FRAME_EVENTS-1);
+		SDL_joyframes[stick->index][i] = delta;
+
+		event.type = SDL_joyframe_type;
+		event.user.code = stick->index;
+		event.user.data1 = &SDL_joyframes[stick->index][i];
+		event.user.data2 = NULL;
+		SDL_PushEvent(&event);
+	}
+}
+
+/* Add the changes between two history frames to the session analytics */
+static __inline__ void CountFrame(SDL_Joystick *stick,
+                                  const struct joyframe *prev, const struct joyframe *frame)
+{
+	SDL_JoystickAnalytics *analytics;
+	Uint32 changed;
+	Uint32 held;
+	int elapsed;
+	int bucket;
+	int i;
+
+	analytics = &stick->hwdata->analytics;
+
+	/* The sticks stayed where the last frame left them until this one */
+	if ( stick->hwdata->history_count > 0 ) {
+		elapsed = frame->timestamp - prev->timestamp;
+		analytics->session_ms += elapsed;
+		for ( i=0; (i < SDL_JOYSTATS_STICKS) && (2*i+1 < stick->naxes); ++i ) {
+			analytics->stick_ms[i][(prev->axes[2*i+1] + 32768) >> 12]
+			                      [(prev->axes[2*i] + 32768) >> 12] += elapsed;
+		}
+	}
+
+	changed = frame->buttons ^ prev->buttons;
+	for ( i=0; changed; ++i, changed >>= 1 ) {
+		if ( !(changed & 1) ) {
+			continue;
+		}
+		if ( frame->buttons & (1 << i) ) {
+			++analytics->presses[i];
+			stick->hwdata->press_time[i] = frame->timestamp;
+		} else {
+			held = frame->timestamp - stick->hwdata->press_time[i];
+			analytics->hold_ms[i] += held;
+			bucket = 0;
+			for ( held >>= 5; held && (bucket < SDL_JOYSTATS_HOLD_BUCKETS-1); held >>= 1 ) {
+				++bucket;
+			}
+			++analytics->holds[i][bucket];
+		}
+	}
+}
+
+/* Add the joystick state just delivered to the input history */
+static __inline__
+void RecordFrame(SDL_Joystick *stick, Uint32 timestamp)
+{
+	static const struct joyframe centered = { 0, 0, { 0 }, SDL_HAT_CENTERED };
+	const struct joyframe *prev;
+	struct joyframe *frame;
+	int i;
+
+	frame = &stick->hwdata->history[stick->hwdata->history_count & (HISTORY_FRAMES-1)];
+	frame->timestamp = timestamp;
+	frame->buttons = 0;
+	for ( i=0; (i < stick->nbuttons) && (i < HISTORY_BUTTONS); ++i ) {
+		if ( stick->buttons[i] ) {
+			frame->buttons |= (1 << i);
+		}
+	}
+	for ( i=0; (i < stick->naxes) && (i < HISTORY_AXES); ++i ) {
+		frame->axes[i] = stick->axes[i];
+	}
+	frame->hat = (stick->nhats > 0) ? stick->hats[0] : SDL_HAT_CENTERED;
+
+	prev = &centered;
+	if ( stick->hwdata->history_count > 0 ) {
+		prev = &stick->hwdata->history[(stick->hwdata->history_count-1) & (HISTORY_FRAMES-1)];
+	}
+	CountFrame(stick, prev, frame);
+
+	if ( SDL_joyshm_owner ) {
+		SHM_PublishFrame(stick, frame);
+	}
+	if ( SDL_joystream.export ) {
+		STREAM_ExportFrame(stick, frame);
+	}
+	if ( SDL_joyframe_type || stick->hwdata->frame_callback ) {
+		DeliverFrame(stick, prev, frame);
+	}
+	++stick->hwdata->history_count;
+}
+
+/* Return a microsecond clock, used to measure sampling skew */
+static Uint32 JS_Microseconds(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return((Uint32)now.tv_sec * 1000000u + (Uint32)now.tv_usec);
+}
+
+/* End the current sampling round, recording its skew if it read more
+   than one port */
+static void JS_FinishRound(void)
+{
+	Uint32 skew;
+
+	if ( SDL_joysampling.round_ports & (SDL_joysampling.round_ports-1) ) {
+		skew = SDL_joysampling.round_end - SDL_joysampling.round_start;
+		++SDL_joysampling.stats.rounds;
+		SDL_joysampling.stats.last_skew = skew;
+		if ( skew > SDL_joysampling.stats.max_skew ) {
+			SDL_joysampling.stats.max_skew = skew;
+		}
+	}
+	SDL_joysampling.round_ports = 0;
+}
+
+/* Note that a port's report has just been read.  A round ends when a
+   port comes round again. */
+static void JS_NoteRead(int port)
+{
+	Uint32 now;
+
+	now = JS_Microseconds();
+	if ( SDL_joysampling.round_ports & (1 << port) ) {
+		JS_FinishRound();
+	}
+	if ( SDL_joysampling.round_ports == 0 ) {
+		SDL_joysampling.round_start = now;
+	}
+	SDL_joysampling.round_ports |= (1 << port);
+	SDL_joysampling.round_end = now;
+}
+
+/* Read one pad's report on its own, returning the pad status */
+static int JS_ReadReport(SDL_Joystick *joystick, Uint8 *joystick_buffer)
+{
+	int joystick_stat;
+	int joystick_rstat;
+
+	/* Check if the joystick is available for use */
+	ioctl(joystick->hwdata->fd, PS2PAD_IOCGETSTAT, &joystick_stat);
+
+	if(joystick_stat == PS2PAD_STAT_READY)
+	{
+		/* Connected pad is ready for action! */
+		memset(joystick_buffer, 0, PS2PAD_DATASIZE);
+
+		/* Wait until the IO is ready for reading */
+		do
+		{
+			joystick_rstat = PS2PAD_RSTAT_BUSY;
+			ioctl(joystick->hwdata->fd, PS2PAD_IOCGETREQSTAT, &joystick_rstat);
+		} while (joystick_rstat == PS2PAD_RSTAT_BUSY);
+
+		read(joystick->hwdata->fd, joystick_buffer, PS2PAD_DATASIZE);
+		JS_NoteRead(SDL_joylist[joystick->index].port);
+	}
+	return(joystick_stat);
+}
+
+/* Read every open pad back to back, for SDL_JOYSTICK_GROUP_SAMPLING.
+   The port status is read once for all of them, each pad is given at most
+   GROUP_WINDOW_US to finish its request, and every report gets the same
+   timestamp.  The reports wait in hwdata until each pad is updated.
+ */
+static void JS_SampleGroup(void)
+{
+	struct ps2pad_stat joystick_port_status[MAX_JOYSTICKS];
+	struct joystick_hwdata *hwdata;
+	SDL_Joystick *joystick;
+	Uint32 start;
+	Uint32 timestamp;
+	int joystick_rstat;
+	int i;
+
+	if ( JS_ReadPortStatus(joystick_port_status, sizeof(joystick_port_status)) < 0 ) {
+		memset(joystick_port_status, 0xFF, sizeof(joystick_port_status));
+	}
+
+	JS_FinishRound();
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		joystick = SDL_joyopen[i];
+		if ( (joystick == NULL) || (SDL_joylist[i].kind != JOYKIND_PS2PAD) ||
+		     joystick->hwdata->gun ) {
+			continue;
+		}
+		hwdata = joystick->hwdata;
+		hwdata->sampled = SDL_TRUE;
+		hwdata->sample_stat = joystick_port_status[SDL_joylist[i].port].stat;
+		if ( hwdata->sample_stat != PS2PAD_STAT_READY ) {
+			continue;
+		}
+
+		memset(hwdata->sample_buffer, 0, sizeof(hwdata->sample_buffer));
+		start = JS_Microseconds();
+		do
+		{
+			joystick_rstat = PS2PAD_RSTAT_BUSY;
+			ioctl(hwdata->fd, PS2PAD_IOCGETREQSTAT, &joystick_rstat);
+		} while ((joystick_rstat == PS2PAD_RSTAT_BUSY) &&
+		         ((JS_Microseconds() - start) < GROUP_WINDOW_US));
+		if ( joystick_rstat == PS2PAD_RSTAT_BUSY ) {
+			/* Leave it for the next round rather than hold up the rest */
+			hwdata->sample_stat = PS2PAD_STAT_BUSY;
+			++SDL_joysampling.stats.overruns;
+			continue;
+		}
+		read(hwdata->fd, hwdata->sample_buffer, sizeof(hwdata->sample_buffer));
+		JS_NoteRead(SDL_joylist[i].port);
+	}
+	JS_FinishRound();
+
+	timestamp = SDL_GetTicks();
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		if ( SDL_joyopen[i] && SDL_joyopen[i]->hwdata->sampled &&
+		     !SDL_joyopen[i]->hwdata->gun ) {
+			SDL_joyopen[i]->hwdata->sample_time = timestamp;
+		}
+	}
+}
+
+/* Read a light gun's report now, to be decoded at its next update */
+static void GUN_Read(SDL_Joystick *joystick)
+{
+	struct joystick_hwdata *hwdata;
+
+	hwdata = joystick->hwdata;
+	hwdata->sample_stat = JS_ReadReport(joystick, hwdata->sample_buffer);
+	hwdata->sample_time = SDL_GetTicks();
+	hwdata->gun_time_us = JS_Microseconds();
+	hwdata->gun_frame = SDL_joygun.frame;
+	hwdata->sampled = SDL_TRUE;
+}
+
+/* Decide whether a light gun is read at this update.  A gun only sees the
+   picture once a frame, so between frames there is nothing new to read.
+   While SDL_JoystickGunFrame() is being called it does the reading, and
+   otherwise the gun is read when a frame period has gone by.
+ */
+static SDL_bool GUN_Sample(SDL_Joystick *joystick)
+{
+	Uint32 now;
+
+	if ( !joystick->hwdata->sampled ) {
+		now = JS_Microseconds();
+		if ( SDL_joygun.frame &&
+		     ((now - SDL_joygun.frame_us) < 2*SDL_joygun.period_us) ) {
+			return(SDL_FALSE);
+		}
+		if ( (now - joystick->hwdata->gun_time_us) < SDL_joygun.period_us ) {
+			return(SDL_FALSE);
+		}
+		GUN_Read(joystick);
+	}
+	joystick->hwdata->sampled = SDL_FALSE;
+	return(SDL_TRUE);
+}
+
+/*
+ * Read every light gun, as a new video frame starts.
+ */
+void SDL_JoystickGunFrame(void)
+{
+	int i;
+
+	++SDL_joygun.frame;
+	SDL_joygun.frame_us = JS_Microseconds();
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		if ( SDL_joyopen[i] && (SDL_joylist[i].kind == JOYKIND_PS2PAD) &&
+		     SDL_joyopen[i]->hwdata->gun ) {
+			GUN_Read(SDL_joyopen[i]);
+		}
+	}
+}
+
+/*
+ * Get the last position read from a light gun.
+ */
+int SDL_JoystickGetGunSample(SDL_Joystick *joystick, SDL_JoystickGunSample *sample)
+{
+	if ( (joystick == NULL) || (joystick->hwdata == NULL) ) {
+		SDL_SetError("Joystick hasn't been opened yet");
+		return(-1);
+	}
+	if ( !joystick->hwdata->gun ) {
+		SDL_SetError("Joystick is not a light gun");
+		return(-1);
+	}
+	*sample = joystick->hwdata->gun_sample;
+	return(0);
+}
+
+/* Function to update the state of a joystick - called as a device poll.
+ * This function shouldn't update the joystick structure directly,
+ * but instead should call SDL_PrivateJoystick*() to deliver events
+ * and update joystick device state.
+ */
+static __inline__ void JS_HandleEvents(SDL_Joystick *joystick)
+{
+	int joystick_stat;
+	Uint32 timestamp;
+
+	Uint8 local_buffer[PS2PAD_DATASIZE];
+	Uint8 *joystick_buffer;
+
+	if ( joystick->hwdata->gun ) {
+		if ( !GUN_Sample(joystick) ) {
+			return;
+		}
+		joystick_stat = joystick->hwdata->sample_stat;
+		joystick_buffer = joystick->hwdata->sample_buffer;
+		timestamp = joystick->hwdata->sample_time;
+	} else if ( SDL_joygroup ) {
+		/* The first pad updated in a round samples all of them */
+		if ( !joystick->hwdata->sampled ) {
+			JS_SampleGroup();
+		}
+		joystick->hwdata->sampled = SDL_FALSE;
+		joystick_stat = joystick->hwdata->sample_stat;
+		joystick_buffer = joystick->hwdata->sample_buffer;
+		timestamp = joystick->hwdata->sample_time;
+	} else {
+		joystick_buffer = local_buffer;
+		joystick_stat = JS_ReadReport(joystick, joystick_buffer);
+		timestamp = SDL_GetTicks();
+	}
+
+	switch(joystick_stat)
+	{
+		case PS2PAD_STAT_READY:
 		{
-			joystick->naxes = 4;
-			joystick->nbuttons = 12;
-			joystick->nballs = 0;
-			joystick->nhats = 1;
-			joystick->nactuators = 2;
-			
-			joystick->actuators = (struct actuator_info *)
-					malloc(joystick->nactuators * sizeof(*joystick->actuators));
-			if ( joystick->actuators ) 
-			{
-				memset(joystick->actuators, 0, joystick->nactuators*sizeof(*joystick->actuators));
-			}
-			
-			/* Describe the actuator propeties */
-			joystick->actuators[0].range = 1;
-			joystick->actuators[0].type = 0;
-
-			joystick->actuators[1].range = 255;
-			joystick->actuators[0].type = 1;
+			/* Deliver the changes, using the routine for this pad type */
+			joystick->hwdata->report_time = timestamp;
+			joystick->hwdata->decode(joystick, joystick_buffer);
+			RecordFrame(joystick, timestamp);
 
-			/* allign actuators */
-			memset(&actuator_align, 0xFF, sizeof(actuator_align.data));
-			actuator_align.len = 6;
-			actuator_align.data[0] = 0;
-			actuator_align.data[1] = 1;
-			ioctl(joystick->hwdata->fd, PS2PAD_IOCSETACTALIGN, &actuator_align);
+			/* Store joystick_buffer for next itteration */
+			memcpy(&joystick->hwdata->old_joystick_buffer, joystick_buffer, PS2PAD_DATASIZE);
 
-			joystick->hwdata->joystick_type = joystick_type;
-			handled = SDL_TRUE;
 			break;
 		}
-		case PS2PAD_TYPE_DIGITAL:
+		case PS2PAD_STAT_NOTCON:
 		{
-			joystick->naxes = 0;
-			joystick->nbuttons = 12;
-			joystick->nballs = 0;
-			joystick->nhats = 1;
-			joystick->nactuators = 0;
-
-			joystick->hwdata->joystick_type = joystick_type;
-			handled = SDL_TRUE;
+			SDL_SetError("No device connected to %s\n",
+			     SDL_joylist[joystick->index].path);
 			break;
 		}
-		case PS2PAD_TYPE_ANALOG:
+		case PS2PAD_STAT_BUSY:
 		{
-			joystick->naxes = 4;
-			joystick->nbuttons = 12;
-			joystick->nballs = 0;
-			joystick->nhats = 1;
-			joystick->nactuators = 0;
-
-			joystick->hwdata->joystick_type = joystick_type;
-			handled = SDL_TRUE;
+			SDL_SetError("Busy device connected to %s\n",
+			     SDL_joylist[joystick->index].path);
 			break;
 		}
-		/* TODO Specifics of this pad are unknown, using as plain digital */
-		case PS2PAD_TYPE_NEJICON:
+		case PS2PAD_STAT_ERROR:
 		{
-			joystick->naxes = 0;
-			joystick->nbuttons = 12;
-			joystick->nballs = 0;
-			joystick->nhats = 1;
-			joystick->nactuators = 0;
-
-			joystick->hwdata->joystick_type = joystick_type;
-			handled = SDL_TRUE;
+			SDL_SetError("Error on device connected to %s\n",
+		             SDL_joylist[joystick->index].path);
 			break;
 		}
-		case 6:
-			/* Namco G-Con 45 light gun!  SDL support forthcomming? */
-
 		default:
 		{
-			/* Support currently unknown controlers in plain digital button mode */
-			SDL_SetError("Unsupported PS2 pad type %d, trying to use as a plain digital pad\n", joystick_type);
-			joystick->naxes = 0;
-			joystick->nbuttons = 12;
-			joystick->nballs = 0;
-			joystick->nhats = 1;
-			joystick->nactuators = 0;
-
-			joystick->hwdata->joystick_type = 0;
-			handled = SDL_TRUE;
+			SDL_SetError("Unknown status on device connected to %s\n",
+		             SDL_joylist[joystick->index].path);
 			break;
 		}
 	}
 
+}
 
-	name = SDL_SYS_JoystickName(joystick->index);
 
-	/* User environment joystick support */
-	if ( (env = getenv("SDL_LINUX_JOYSTICK")) ) {
-		strcpy(env_name, "");
-		if ( *env == '\'' && sscanf(env, "'%[^']s'", env_name) == 1 )
-			env += strlen(env_name)+2;
-		else if ( sscanf(env, "%s", env_name) == 1 )
-			env += strlen(env_name);
+#ifdef USE_INPUT_EVENTS
+static __inline__ int EV_AxisCorrect(SDL_Joystick *joystick, int which, int value)
+{
+	struct axis_correct *correct;
 
-		if ( strcmp(name, env_name) == 0 ) {
+	correct = &joystick->hwdata->abs_correct[which];
+	if ( correct->used ) {
+		if ( value > correct->coef[0] ) {
+			if ( value < correct->coef[1] ) {
+				return 0;
+			}
+			value -= correct->coef[1];
+		} else {
+			value -= correct->coef[0];
+		}
+		value *= correct->coef[2];
+		value >>= 14;
+	}
+
+	/* Clamp and return */
+	if ( value < -32767 ) return -32767;
+	if ( value >  32767 ) return  32767;
 
-			if ( sscanf(env, "%d %d %d", &tmp_naxes, &tmp_nhats,
-				&tmp_nballs) == 3 ) {
+	return value;
+}
 
-				joystick->naxes = tmp_naxes;
-				joystick->nhats = tmp_nhats;
-				joystick->nballs = tmp_nballs;
+static __inline__ void EV_HandleEvents(SDL_Joystick *joystick)
+{
+	struct input_event events[32];
+	int i, len;
+	int code;
+	int axis;
+	int value;
+	SDL_bool changed;
 
-				handled = SDL_TRUE;
+	changed = SDL_FALSE;
+	while ((len=read(joystick->hwdata->fd, events, (sizeof events))) > 0) {
+		if ( !changed && joystick->hwdata->filter_on ) {
+			joystick->hwdata->report_time = SDL_GetTicks();
+		}
+		changed = SDL_TRUE;
+		len /= sizeof(events[0]);
+		for ( i=0; i<len; ++i ) {
+			code = events[i].code;
+			switch (events[i].type) {
+			    case EV_KEY:
+				if ( code >= BTN_MISC ) {
+					code -= BTN_MISC;
+					SDL_PrivateJoystickButton(joystick,
+				           joystick->hwdata->key_map[code],
+					   events[i].value);
+				}
+				break;
+			    case EV_ABS:
+				switch (code) {
+				    case ABS_HAT0X:
+				    case ABS_HAT0Y:
+				    case ABS_HAT1X:
+				    case ABS_HAT1Y:
+				    case ABS_HAT2X:
+				    case ABS_HAT2Y:
+				    case ABS_HAT3X:
+				    case ABS_HAT3Y:
+					code -= ABS_HAT0X;
+					HandleHat(joystick, code/2, code%2,
+							events[i].value);
+					break;
+				    default:
+					axis = joystick->hwdata->abs_map[code];
+					value = EV_AxisCorrect(joystick, code, events[i].value);
+					if ( joystick->hwdata->filter_on && (axis < FILTER_AXES) &&
+					     !FilterAxis(joystick, axis, &value,
+					                 joystick->hwdata->report_time) ) {
+						break;
+					}
+					SDL_PrivateJoystickAxis(joystick, axis, value);
+					break;
+				}
+				break;
+			    case EV_REL:
+				switch (code) {
+				    case REL_X:
+				    case REL_Y:
+					code -= REL_X;
+					HandleBall(joystick, code/2, code%2,
+							events[i].value);
+					break;
+				    default:
+					break;
+				}
+				break;
+			    default:
+				break;
 			}
 		}
 	}
 
-	/* Remap hats and balls */
-	if (handled) {
-		if ( joystick->nhats > 0 ) {
-			if ( allocate_hatdata(joystick) < 0 ) {
-				joystick->nhats = 0;
-			}
+	/* The device only reports changes, so run the filter on for any axis
+	   that hasn't caught up with the last one */
+	if ( joystick->hwdata->filter_unsettled ) {
+		if ( !changed ) {
+			joystick->hwdata->report_time = SDL_GetTicks();
 		}
-		if ( joystick->nballs > 0 ) {
-			if ( allocate_balldata(joystick) < 0 ) {
-				joystick->nballs = 0;
+		for ( axis=0; axis < FILTER_AXES; ++axis ) {
+			if ( joystick->hwdata->filter_unsettled & (1 << axis) ) {
+				value = joystick->hwdata->filter[axis].raw;
+				if ( FilterAxis(joystick, axis, &value,
+				                joystick->hwdata->report_time) ) {
+					SDL_PrivateJoystickAxis(joystick, axis, value);
+					changed = SDL_TRUE;
+				}
 			}
 		}
 	}
-	return(handled);
-}
 
-#ifdef USE_INPUT_EVENTS
+	if ( changed ) {
+		RecordFrame(joystick, joystick->hwdata->filter_on ?
+		            joystick->hwdata->report_time : SDL_GetTicks());
+	}
+}
+#endif /* USE_INPUT_EVENTS */
 
-static SDL_bool EV_ConfigJoystick(SDL_Joystick *joystick, int fd)
+/* Bring a joystick fed by another process up to a frame it sent */
+static void ApplyRemoteFrame(SDL_Joystick *joystick,
+                             const struct joyframe *frame, Uint32 timestamp)
 {
+	struct joyframe *state;
+	Uint32 changed;
 	int i;
-	unsigned long keybit[40];
-	unsigned long absbit[40];
-	unsigned long relbit[40];
 
-	/* See if this device uses the new unified event API */
-	if ( (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keybit)), keybit) >= 0) &&
-	     (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absbit)), absbit) >= 0) &&
-	     (ioctl(fd, EVIOCGBIT(EV_REL, sizeof(relbit)), relbit) >= 0) ) {
-		joystick->hwdata->is_hid = SDL_TRUE;
+	state = &joystick->hwdata->remote_state;
+	if ( (joystick->nhats > 0) && (frame->hat != state->hat) ) {
+		SDL_PrivateJoystickHat(joystick, 0, frame->hat);
+	}
+	changed = frame->buttons ^ state->buttons;
+	for ( i=0; changed && (i < joystick->nbuttons); ++i ) {
+		if ( changed & (1 << i) ) {
+			SDL_PrivateJoystickButton(joystick, i,
+				(frame->buttons & (1 << i)) ? SDL_PRESSED : SDL_RELEASED);
+		}
+	}
+	for ( i=0; (i < joystick->naxes) && (i < HISTORY_AXES); ++i ) {
+		if ( frame->axes[i] != state->axes[i] ) {
+			SDL_PrivateJoystickAxis(joystick, i, frame->axes[i]);
+		}
+	}
+	*state = *frame;
+	RecordFrame(joystick, timestamp);
+}
 
-		/* Get the number of buttons, axes, and other thingamajigs */
-		for ( i=BTN_JOYSTICK; i < KEY_MAX; ++i ) {
-			if ( test_bit(i, keybit) ) {
-#ifdef DEBUG_INPUT_EVENTS
-				printf("Joystick has button: 0x%x\n", i);
-#endif
-				joystick->hwdata->key_map[i-BTN_MISC] =
-						joystick->nbuttons;
-				++joystick->nbuttons;
-			}
+/* Deliver the frames the owning process has published since the last
+   update.  Nothing here makes a system call unless a frame arrived. */
+static __inline__ void SHM_HandleEvents(SDL_Joystick *joystick)
+{
+	struct joystick_hwdata *hwdata;
+	const struct joyshm_pad *pad;
+	struct joyframe frame;
+	Uint32 count;
+
+	hwdata = joystick->hwdata;
+	pad = &SDL_joyshm->pads[SDL_joylist[joystick->index].port];
+	count = pad->frame_count;
+	if ( count == hwdata->shm_frame_count ) {
+		return;
+	}
+	JOYSHM_BARRIER();
+
+	while ( hwdata->shm_frame_count != count ) {
+		/* Skip what the owner has already overwritten */
+		if ( (pad->frame_count - hwdata->shm_frame_count) >= JOYSHM_FRAMES ) {
+			hwdata->shm_frame_count = pad->frame_count - (JOYSHM_FRAMES-1);
+			count = pad->frame_count;
+			continue;
 		}
-		for ( i=BTN_MISC; i < BTN_JOYSTICK; ++i ) {
-			if ( test_bit(i, keybit) ) {
-#ifdef DEBUG_INPUT_EVENTS
-				printf("Joystick has button: 0x%x\n", i);
-#endif
-				joystick->hwdata->key_map[i-BTN_MISC] =
-						joystick->nbuttons;
-				++joystick->nbuttons;
-			}
+		frame = pad->frames[hwdata->shm_frame_count & (JOYSHM_FRAMES-1)];
+		JOYSHM_BARRIER();
+		if ( (pad->frame_count - hwdata->shm_frame_count) >= JOYSHM_FRAMES ) {
+			continue;
 		}
-		for ( i=0; i<ABS_MAX; ++i ) {
-			/* Skip hats */
-			if ( i == ABS_HAT0X ) {
-				i = ABS_HAT3Y;
-				continue;
-			}
-			if ( test_bit(i, absbit) ) {
-				int values[5];
+		++hwdata->shm_frame_count;
 
-				ioctl(fd, EVIOCGABS(i), values);
-#ifdef DEBUG_INPUT_EVENTS
-				printf("Joystick has absolute axis: %x\n", i);
-				printf("Values = { %d, %d, %d, %d, %d }\n",
-					values[0], values[1],
-					values[2], values[3], values[4]);
-#endif /* DEBUG_INPUT_EVENTS */
-				joystick->hwdata->abs_map[i] = joystick->naxes;
-				if ( values[1] == values[2] ) {
-				    joystick->hwdata->abs_correct[i].used = 0;
-				} else {
-				    joystick->hwdata->abs_correct[i].used = 1;
-				    joystick->hwdata->abs_correct[i].coef[0] =
-					(values[2] + values[1]) / 2 - values[4];
-				    joystick->hwdata->abs_correct[i].coef[1] =
-					(values[2] + values[1]) / 2 + values[4];
-				    joystick->hwdata->abs_correct[i].coef[2] =
-					(1 << 29) / ((values[2] - values[1]) / 2 - 2 * values[4]);
-				}
-				++joystick->naxes;
-			}
+		frame.timestamp += hwdata->shm_clock_offset;
+		ApplyRemoteFrame(joystick, &frame, frame.timestamp);
+	}
+}
+
+static void HapticsUpdate(SDL_Joystick *joystick);
+
+void SDL_SYS_JoystickUpdate(SDL_Joystick *joystick)
+{
+	int i;
+
+	if ( SDL_joylist[joystick->index].kind == JOYKIND_SHM ) {
+		SHM_HandleEvents(joystick);
+		return;
+	}
+	if ( SDL_joylist[joystick->index].kind == JOYKIND_STREAM ) {
+		STREAM_Read(SDL_TRUE);
+		return;
+	}
+
+#ifdef USE_INPUT_EVENTS
+	if ( joystick->hwdata->is_hid )
+		EV_HandleEvents(joystick);
+	else
+#endif
+		JS_HandleEvents(joystick);
+
+	/* Deliver ball motion updates */
+	for ( i=0; i<joystick->nballs; ++i ) {
+		int xrel, yrel;
+
+		xrel = joystick->hwdata->balls[i].axis[0];
+		yrel = joystick->hwdata->balls[i].axis[1];
+		if ( xrel || yrel ) {
+			joystick->hwdata->balls[i].axis[0] = 0;
+			joystick->hwdata->balls[i].axis[1] = 0;
+			SDL_PrivateJoystickBall(joystick, (Uint8)i, xrel, yrel);
 		}
-		for ( i=ABS_HAT0X; i <= ABS_HAT3Y; i += 2 ) {
-			if ( test_bit(i, absbit) || test_bit(i+1, absbit) ) {
-#ifdef DEBUG_INPUT_EVENTS
-				printf("Joystick has hat %d\n",(i-ABS_HAT0X)/2);
-#endif
-				++joystick->nhats;
-			}
+	}
+
+	if ( joystick->hwdata->haptics_on ) {
+		HapticsUpdate(joystick);
+	}
+
+	/* Send the frames of every joystick together, after the last one */
+	if ( SDL_joystream.export ) {
+		i = joystick->index+1;
+		while ( (i < MAX_JOYSTICKS) && !SDL_joyopen[i] ) {
+			++i;
 		}
-		if ( test_bit(REL_X, relbit) || test_bit(REL_Y, relbit) ) {
-			++joystick->nballs;
+		if ( i == MAX_JOYSTICKS ) {
+			STREAM_Flush();
 		}
+	}
+}
 
-		/* Allocate data to keep track of these thingamajigs */
-		if ( joystick->nhats > 0 ) {
-			if ( allocate_hatdata(joystick) < 0 ) {
-				joystick->nhats = 0;
-			}
-		}
-		if ( joystick->nballs > 0 ) {
-			if ( allocate_balldata(joystick) < 0 ) {
-				joystick->nballs = 0;
-			}
+/* Find the newest recorded frame taken at or before a time.
+   Returns how many frames back it is, or -1 if it is older than the history.
+ */
+static int FindFrame(SDL_Joystick *joystick, Uint32 ticks)
+{
+	struct joystick_hwdata *hwdata;
+	int n, count;
+
+	hwdata = joystick->hwdata;
+	count = (hwdata->history_count < HISTORY_FRAMES) ?
+		hwdata->history_count : HISTORY_FRAMES;
+	for ( n=0; n<count; ++n ) {
+		if ( (Sint32)(ticks - hwdata->history[(hwdata->history_count-1-n) &
+		                                     (HISTORY_FRAMES-1)].timestamp) >= 0 ) {
+			return(n);
 		}
 	}
-	return(joystick->hwdata->is_hid);
+	SDL_SetError("No joystick history at %u ms", ticks);
+	return(-1);
 }
 
-#endif /* USE_INPUT_EVENTS */
+#define HISTORY_FRAME(hwdata, n) \
+	(&(hwdata)->history[((hwdata)->history_count-1-(n)) & (HISTORY_FRAMES-1)])
 
-/* Function to open a joystick for use.
-   The joystick to open is specified by the index field of the joystick.
-   This should fill the nbuttons and naxes fields of the joystick structure.
-   It returns 0, or -1 if there is an error.
+/*
+ * Get the state of an axis control on a joystick at a time in the recent
+ * past, as reported by SDL_GetTicks().
  */
-int SDL_SYS_JoystickOpen(SDL_Joystick *joystick)
+int SDL_JoystickGetAxisAt(SDL_Joystick *joystick, int axis, Uint32 ticks,
+                          int interpolation, Sint16 *value)
 {
-	int fd;
-	int joystick_stat;
+	const struct joyframe *frame, *later;
+	Sint32 span, offset;
+	int n;
 
-	/* Open the joystick and set the joystick file descriptor */
-	fd = open(SDL_joylist[joystick->index], O_RDONLY, 0);
-	if ( fd < 0 ) {
-		SDL_SetError("Unable to open %s\n",
-		             SDL_joylist[joystick->index]);
+	if ( (joystick == NULL) || (joystick->hwdata == NULL) ) {
+		SDL_SetError("Joystick hasn't been opened yet");
+		return(-1);
+	}
+	if ( (axis < 0) || (axis >= joystick->naxes) || (axis >= HISTORY_AXES) ) {
+		SDL_SetError("Joystick history only has %d axes",
+			(joystick->naxes < HISTORY_AXES) ? joystick->naxes : HISTORY_AXES);
 		return(-1);
 	}
+	n = FindFrame(joystick, ticks);
+	if ( n < 0 ) {
+		return(-1);
+	}
+	frame = HISTORY_FRAME(joystick->hwdata, n);
+	*value = frame->axes[axis];
 
-	/* Check if the joystick is available for use */
-	ioctl(fd, PS2PAD_IOCGETSTAT, &joystick_stat);
-	switch(joystick_stat)
-	{
-		case PS2PAD_STAT_NOTCON:
-		{
-			SDL_SetError("No device connected to %s\n",
-		             SDL_joylist[joystick->index]);
-			return(-1);
+	/* Past the newest frame the value is simply held */
+	if ( n == 0 ) {
+		return(0);
+	}
+	later = HISTORY_FRAME(joystick->hwdata, n-1);
+	span = (Sint32)(later->timestamp - frame->timestamp);
+	offset = (Sint32)(ticks - frame->timestamp);
+	if ( interpolation == SDL_JOYHISTORY_LINEAR ) {
+		/* The product must fit 32 bits, even after a long idle gap */
+		while ( span > 0x7FFF ) {
+			span >>= 1;
+			offset >>= 1;
 		}
-		case PS2PAD_STAT_BUSY:
-		{
-			/* TODO Possibly wait for a certain time to allow for delays */
-			SDL_SetError("Busy device connected to %s\n",
-		             SDL_joylist[joystick->index]);
-			return(-1);
+		if ( span > 0 ) {
+			*value = frame->axes[axis] +
+				((later->axes[axis] - frame->axes[axis]) * offset) / span;
 		}
-		case PS2PAD_STAT_READY:
+	} else if ( offset > (span - offset) ) {
+		*value = later->axes[axis];
+	}
+	return(0);
+}
+
+/*
+ * Get the button presses and releases recorded for a joystick between
+ * start (inclusive) and end (exclusive), oldest first.
+ */
+int SDL_JoystickGetButtonTransitions(SDL_Joystick *joystick,
+                                     Uint32 start, Uint32 end,
+                                     SDL_JoyButtonTransition *transitions,
+                                     int maxtransitions)
+{
+	struct joystick_hwdata *hwdata;
+	const struct joyframe *frame, *earlier;
+	Uint32 changed;
+	int n, count, numtransitions, button;
+
+	if ( (joystick == NULL) || (joystick->hwdata == NULL) ) {
+		SDL_SetError("Joystick hasn't been opened yet");
+		return(-1);
+	}
+	if ( (maxtransitions < 0) || ((transitions == NULL) && (maxtransitions > 0)) ) {
+		SDL_SetError("Invalid transitions buffer");
+		return(-1);
+	}
+	hwdata = joystick->hwdata;
+	count = (hwdata->history_count < HISTORY_FRAMES) ?
+		hwdata->history_count : HISTORY_FRAMES;
+
+	/* The oldest frame has nothing to compare with, so it is skipped */
+	numtransitions = 0;
+	for ( n=count-2; n>=0; --n ) {
+		frame = HISTORY_FRAME(hwdata, n);
+		if ( ((Sint32)(frame->timestamp - start) < 0) ||
+		     ((Sint32)(frame->timestamp - end) >= 0) ) {
+			continue;
+		}
+		earlier = HISTORY_FRAME(hwdata, n+1);
+		changed = frame->buttons ^ earlier->buttons;
+		for ( button=0; changed && (button < HISTORY_BUTTONS); ++button ) {
+			if ( changed & (1 << button) ) {
+				changed &= ~(1 << button);
+				if ( numtransitions == maxtransitions ) {
+					return(numtransitions);
+				}
+				transitions[numtransitions].timestamp = frame->timestamp;
+				transitions[numtransitions].button = button;
+				transitions[numtransitions].state =
+					(frame->buttons & (1 << button)) ? SDL_PRESSED : SDL_RELEASED;
+				++numtransitions;
+			}
+		}
+	}
+	return(numtransitions);
+}
+
+/*
+ * Record an actuator value of a joystick, without sending it.
+ * The actuator indices start at index 0.
+   On the PS2 DualShock 1/2:
+	actuator 0 (small) has a boolean frequency
+	actuator 1 (big) has 0-255 range
+   Both of these are normalised to within the 0-65535 SDL range.
+   A controller mapping may reorder or hide them, see actuator_map.
+ */
+static int StoreActuator(SDL_Joystick *joystick, int actuator, int frequency)
+{
+	int normalised_frequency;
+
+#ifdef USE_INPUT_EVENTS
+	/* Force feedback magnitudes are kept to the 0-255 range reported */
+	if ( joystick->hwdata->is_hid ) {
+		normalised_frequency = frequency >> 8;
+	} else
+#endif
+	switch(joystick->hwdata->actuator_map[actuator])
+	{
+		case 0:
 		{
-			/* Joystick is ready for action! */
+			normalised_frequency = (frequency > 1);
 			break;
 		}
-		case PS2PAD_STAT_ERROR:
+		case 1:
 		{
-			SDL_SetError("Error on device connected to %s\n",
-		             SDL_joylist[joystick->index]);
-			return(-1);
+			/* Normalise to within PS2 Actuator range for actuator 1 */
+			normalised_frequency = frequency >> 8;
+			break;
 		}
 		default:
 		{
-			SDL_SetError("Unknown status on device connected to %s\n",
-		             SDL_joylist[joystick->index]);
-			return(-1);
+			SDL_SetError("Unknown actuator: %d\n", actuator);
+			return 1;
 		}
 	}
 
-	joystick->hwdata = (struct joystick_hwdata *)
-	                   malloc(sizeof(*joystick->hwdata));
-	if ( joystick->hwdata == NULL ) {
-		SDL_OutOfMemory();
-		close(fd);
-		return(-1);
+	(joystick->actuators + actuator)->frequency = frequency;
+	if(joystick->actuators[actuator].normalised != normalised_frequency) {
+		/* Count the use of the actuator for the session analytics */
+		if ( actuator < SDL_JOYSTATS_ACTUATORS ) {
+			++joystick->hwdata->analytics.actuator_changes[actuator];
+			if ( !joystick->actuators[actuator].normalised ) {
+				++joystick->hwdata->analytics.actuator_activations[actuator];
+				joystick->hwdata->actuator_on_time[actuator] = SDL_GetTicks();
+			} else if ( !normalised_frequency ) {
+				joystick->hwdata->analytics.actuator_ms[actuator] +=
+					SDL_GetTicks() - joystick->hwdata->actuator_on_time[actuator];
+			}
+		}
+		joystick->actuators[actuator].normalised = normalised_frequency;
+		joystick->hwdata->actuators_dirty = SDL_TRUE;
 	}
-	
-	/* Wipe clean the hwdata struct, including joystick buffers */
-	memset(joystick->hwdata, 0, sizeof(*joystick->hwdata));
+	return 0;
+}
 
-	joystick->hwdata->fd = fd;
+/* Send every actuator of a pad in one PS2PAD_IOCSETACT */
+static int JS_FlushActuators(SDL_Joystick *joystick)
+{
+	struct ps2pad_act actuator_buffer;
+	int loop;
 
-	/* Set the joystick to non-blocking read mode */
-	fcntl(fd, F_SETFL, O_NONBLOCK);
+	/* Every motor is sent each time, in the order the pad expects */
+	memset(&actuator_buffer, 0, sizeof(actuator_buffer));
+	actuator_buffer.len = 6;
+	for(loop = 0; loop < joystick->nactuators; loop++) {
+		actuator_buffer.data[joystick->hwdata->actuator_map[loop]] =
+			joystick->actuators[loop].normalised;
+	}
+
+	if ( ioctl(joystick->hwdata->fd, PS2PAD_IOCSETACT, &actuator_buffer) < 0 ) {
+		SDL_SetError("Unable to set actuators of %s\n",
+		             SDL_joylist[joystick->index].path);
+		return 1;
+	}
+	return 0;
+}
 
-	/* Get the number of buttons and axes on the joystick */
 #ifdef USE_INPUT_EVENTS
-	if ( ! EV_ConfigJoystick(joystick, fd) )
-#endif
-		JS_ConfigJoystick(joystick, fd);
+/* Start or stop the uploaded force feedback effect */
+static int EV_PlayEffect(SDL_Joystick *joystick, int play)
+{
+	struct input_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.type = EV_FF;
+	event.code = joystick->hwdata->ff_effect.id;
+	event.value = play;
+	if ( write(joystick->hwdata->fd, &event, sizeof(event)) != sizeof(event) ) {
+		SDL_SetError("Unable to %s force feedback effect on %s\n",
+		             play ? "start" : "stop",
+		             SDL_joylist[joystick->index].path);
+		return 1;
+	}
+	joystick->hwdata->ff_playing = play;
+	return 0;
+}
 
-	return(0);
+/* Bring the force feedback effect in line with the actuator levels.
+   The effect is only uploaded again when a level actually changed while
+   a motor is running; switching the motors off and back on to the same
+   levels is just a pair of EV_FF writes.
+ */
+static int EV_FlushActuators(SDL_Joystick *joystick)
+{
+	struct joystick_hwdata *hwdata;
+	struct ff_effect effect;
+	int loop;
+	int running;
+
+	hwdata = joystick->hwdata;
+	running = 0;
+	for(loop = 0; loop < joystick->nactuators; loop++) {
+		running |= joystick->actuators[loop].normalised;
+	}
+
+	if ( !running ) {
+		if ( hwdata->ff_playing ) {
+			return EV_PlayEffect(joystick, 0);
+		}
+		return 0;
+	}
+
+	effect = hwdata->ff_effect;
+	if ( hwdata->ff_type == FF_RUMBLE ) {
+		effect.u.rumble.weak_magnitude =
+			joystick->actuators[0].normalised * 0x101;
+		effect.u.rumble.strong_magnitude =
+			joystick->actuators[1].normalised * 0x101;
+	} else {
+		effect.u.periodic.magnitude =
+			joystick->actuators[0].normalised * 0x80;
+	}
+	if ( (effect.id < 0) ||
+	     (memcmp(&effect, &hwdata->ff_effect, sizeof(effect)) != 0) ) {
+		/* An id of -1 allocates a slot, otherwise the effect is updated */
+		if ( ioctl(hwdata->fd, EVIOCSFF, &effect) < 0 ) {
+			SDL_SetError("Unable to upload force feedback effect to %s\n",
+			             SDL_joylist[joystick->index].path);
+			return 1;
+		}
+		hwdata->ff_effect = effect;
+	}
+	if ( !hwdata->ff_playing ) {
+		return EV_PlayEffect(joystick, 1);
+	}
+	return 0;
 }
+#endif /* USE_INPUT_EVENTS */
 
-static __inline__
-void HandleHat(SDL_Joystick *stick, Uint8 hat, int axis, int value)
+/* Send every actuator of a joystick in one update, if any has changed.
+   A joystick stays dirty when the update fails, so the next one retries.
+ */
+static int FlushActuators(SDL_Joystick *joystick)
 {
-	struct hwdata_hat *the_hat;
-	const Uint8 position_map[3][3] = {
-		{ SDL_HAT_LEFTUP, SDL_HAT_UP, SDL_HAT_RIGHTUP },
-		{ SDL_HAT_LEFT, SDL_HAT_CENTERED, SDL_HAT_RIGHT },
-		{ SDL_HAT_LEFTDOWN, SDL_HAT_DOWN, SDL_HAT_RIGHTDOWN }
-	};
+	int status;
 
-	the_hat = &stick->hwdata->hats[hat];
-	if ( value < 0 ) {
-		value = 0;
-	} else
-	if ( value == 0 ) {
-		value = 1;
-	} else
-	if ( value > 0 ) {
-		value = 2;
+	if(!joystick->hwdata->actuators_dirty) {
+		return 0;
 	}
-	if ( value != the_hat->axis[axis] ) {
-		the_hat->axis[axis] = value;
-		SDL_PrivateJoystickHat(stick, hat,
-			position_map[the_hat->axis[1]][the_hat->axis[0]]);
+#ifdef USE_INPUT_EVENTS
+	if ( joystick->hwdata->is_hid ) {
+		status = EV_FlushActuators(joystick);
+	} else
+#endif
+		status = JS_FlushActuators(joystick);
+	if(status == 0) {
+		joystick->hwdata->actuators_dirty = SDL_FALSE;
 	}
+	return status;
 }
 
-static __inline__
-void HandleBall(SDL_Joystick *stick, Uint8 ball, int axis, int value)
+/*
+ * Set an actuator value of a joystick
+ * The actuator indices start at index 0.
+ */
+int SDL_SYS_JoystickSetActuator(SDL_Joystick *joystick, int actuator, int frequency)
 {
-	stick->hwdata->balls[ball].axis[axis] += value;
+	if(StoreActuator(joystick, actuator, frequency) != 0) {
+		return 1;
+	}
+
+	/* printf("\tSDL_SYS_JoystickSetActuator act: %d freq: %d\n", actuator, frequency); */
+	return FlushActuators(joystick);
 }
 
-/* Function to update the state of a joystick - called as a device poll.
- * This function shouldn't update the joystick structure directly,
- * but instead should call SDL_PrivateJoystick*() to deliver events
- * and update joystick device state.
+/*
+ * Set several actuators, on one or more joysticks, together.
+ * Each joystick gets a single PS2PAD_IOCSETACT covering all of its
+ * actuators, once every level has been recorded.
  */
-static __inline__ void JS_HandleEvents(SDL_Joystick *joystick)
+int SDL_JoystickSetActuators(const SDL_JoystickActuatorLevel *levels, int numlevels)
 {
-	int joystick_stat;
-	int joystick_rstat;
+	SDL_Joystick *joystick;
+	int loop;
+	int status;
 
-	Uint8 joystick_buffer[PS2PAD_DATASIZE];
-	Uint32 joystick_buttons;
-	Uint32 joystick_buttons_xor;
-	int hat_event_temp;
-	int button_loop;
+	/* Check everything first, so a bad entry changes nothing */
+	if((numlevels < 0) || ((levels == NULL) && (numlevels > 0))) {
+		SDL_SetError("Invalid list of %d actuator levels", numlevels);
+		return 1;
+	}
+	for(loop = 0; loop < numlevels; loop++) {
+		joystick = levels[loop].joystick;
+		if((joystick == NULL) || (joystick->hwdata == NULL)) {
+			SDL_SetError("Joystick hasn't been opened yet");
+			return 1;
+		}
+		if((levels[loop].actuator < 0) ||
+		   (levels[loop].actuator > (joystick->nactuators - 1))) {
+			SDL_SetError("Joystick only has %d actuators",joystick->nactuators);
+			return 1;
+		}
+		if(levels[loop].frequency > 0xFFFF || levels[loop].frequency < 0) {
+			SDL_SetError("Actuator frequency was not within the valid range 0-65536: %d", levels[loop].frequency);
+			return 1;
+		}
+	}
 
-	/* Mapping is the same as in Linux Joystick code.  With the exception of L3 and R3
-	because these are new numbers (Linux JS code did not support before).  Definition 
-	of these 12 PS2 Direction Pad control buttons is used in the xor comparison */
-	const int button_index[NUM_BUTTONS] = {
-			PS2PAD_BUTTON_SQUARE,
-			PS2PAD_BUTTON_CROSS,
-			PS2PAD_BUTTON_TRIANGLE,	/* The same as PS2PAD_BUTTON_B */
-			PS2PAD_BUTTON_CIRCLE,	/* The same as PS2PAD_BUTTON_A */
-			PS2PAD_BUTTON_L1,
-			PS2PAD_BUTTON_R1,	/* The same as PS2PAD_BUTTON_R */
-			PS2PAD_BUTTON_L2,
-			PS2PAD_BUTTON_R2,
-			PS2PAD_BUTTON_SELECT,
-			PS2PAD_BUTTON_START,
-			PS2PAD_BUTTON_L3,
-			PS2PAD_BUTTON_R3 };
-
-
-	joystick_buttons = 0;
+	for(loop = 0; loop < numlevels; loop++) {
+		if(StoreActuator(levels[loop].joystick, levels[loop].actuator,
+		                    levels[loop].frequency) != 0) {
+			return 1;
+		}
+	}
 
-	/* Check if the joystick is available for use */
-	ioctl(joystick->hwdata->fd, PS2PAD_IOCGETSTAT, &joystick_stat);
+	/* A joystick is clean again once flushed, so each is sent only once;
+	   one that fails is still tried again by its next entry. */
+	status = 0;
+	for(loop = 0; loop < numlevels; loop++) {
+		if(FlushActuators(levels[loop].joystick) != 0) {
+			status = 1;
+		}
+	}
+	return status;
+}
 
-	switch(joystick_stat)
-	{
-		case PS2PAD_STAT_READY:
-		{
-			/* Connected pad is ready for action! */
-			memset(&joystick_buffer, 0, sizeof(joystick_buffer));
 
-			/* Wait until the IO is ready for reading */
-			do
-			{
-				joystick_rstat = PS2PAD_RSTAT_BUSY;
-				ioctl(joystick->hwdata->fd, PS2PAD_IOCGETREQSTAT, &joystick_rstat);
-			} while (joystick_rstat == PS2PAD_RSTAT_BUSY);
-
-			read(joystick->hwdata->fd, joystick_buffer, sizeof(joystick_buffer));
-			joystick_buttons = ~(((unsigned long)joystick_buffer[0] << 24)
-				| ((unsigned long)joystick_buffer[1] << 16)
-				| ((unsigned long)joystick_buffer[2] << 8)
-				| (joystick_buffer[3] << 0));
-
-			/* Evaluate the button states that have changed since the last update.
-			   Only send updates for changes in in the joystick state! */
-			joystick_buttons_xor = joystick_buttons ^ joystick->hwdata->old_joystick_buttons;
-
-			/* Check if there is a change in the joystick hat (Direction pad) */
-			if(joystick_buttons_xor & (PS2PAD_BUTTON_LEFT | PS2PAD_BUTTON_RIGHT | PS2PAD_BUTTON_UP | PS2PAD_BUTTON_DOWN))
-			{
-				hat_event_temp = SDL_HAT_CENTERED;
-				if(joystick_buttons_xor & PS2PAD_BUTTON_LEFT)	hat_event_temp |= SDL_HAT_LEFT;
-				if(joystick_buttons_xor & PS2PAD_BUTTON_RIGHT)	hat_event_temp |= SDL_HAT_RIGHT;
-				if(joystick_buttons_xor & PS2PAD_BUTTON_UP)	hat_event_temp |= SDL_HAT_UP;
-				if(joystick_buttons_xor & PS2PAD_BUTTON_DOWN)	hat_event_temp |= SDL_HAT_DOWN;
-				SDL_PrivateJoystickHat(joystick, 0, hat_event_temp);
-			}
+/* Audio driven haptics.
+   SDL_JoystickFeedAudio() is called from the audio callback.  It sums the
+   audio to mono in blocks of JOYHAPTIC_BLOCK frames, which is also a crude
+   low pass, and for each joystick with haptics on runs the blocks through
+   a band pass (two one pole low passes, subtracted) and a peak envelope
+   follower.  All of it is 16 bit fixed point with Q12 coefficients, and
+   it neither allocates nor makes system calls.  The envelope is then
+   turned into a level for each actuator, which the joystick's own update
+   sends to the pad, at most once every interval_ms.
+ */
+#define JOYHAPTIC_BLOCK		8	/* Frames summed into one filter step */
+#define JOYHAPTIC_ATTACK_HZ	40	/* Envelope rise, about 4 ms */
+#define JOYHAPTIC_RELEASE_HZ	3	/* Envelope fall, about 50 ms */
+#define JOYHAPTIC_MAX_GAIN	4096	/* 16 times full level, well inside an int */
 
-			/* Check each remaining button and send a button event if it has changed */
-			for(button_loop = 0; button_loop < NUM_BUTTONS; button_loop++)
-			{
-				if(joystick_buttons_xor & button_index[button_loop])
-				{
-					SDL_PrivateJoystickButton(joystick, button_loop, (joystick_buttons & button_index[button_loop]) ? SDL_PRESSED : SDL_RELEASED);
-				}
+/* The joysticks with haptics on.  The audio thread only finds them here,
+   never in SDL_joyopen, and it is only changed under SDL_LockAudio(), so
+   a joystick is off the list before it is closed and freed. */
+static SDL_Joystick *SDL_joyhaptics[MAX_JOYSTICKS];
+
+/* The block being summed, shared by every joystick */
+static int SDL_joyhaptics_sum = 0;
+static int SDL_joyhaptics_frames = 0;
+
+static int HapticsCoefficient(int hz, int rate)
+{
+	return((int)(JoyFilterAlpha((float)hz, (float)JOYHAPTIC_BLOCK / rate) * 4096.0f));
+}
+
+/* Run one block, the mean of its samples, through a joystick's filters */
+static __inline__ void HapticsStep(struct joystick_hwdata *hwdata, int sample)
+{
+	int band;
+	int rectified;
+
+	hwdata->haptics_state[0] += ((sample - hwdata->haptics_state[0]) *
+	                             hwdata->haptics_coef[0]) >> 12;
+	hwdata->haptics_state[1] += ((hwdata->haptics_state[0] - hwdata->haptics_state[1]) *
+	                             hwdata->haptics_coef[1]) >> 12;
+	band = hwdata->haptics_state[0] - hwdata->haptics_state[1];
+	rectified = (band ^ (band >> 31)) - (band >> 31);
+	hwdata->haptics_state[2] += ((rectified - hwdata->haptics_state[2]) *
+	                             hwdata->haptics_coef[(rectified > hwdata->haptics_state[2]) ? 2 : 3]) >> 12;
+}
+
+/* Turn a joystick's envelope into the frequency wanted of each actuator */
+static void HapticsLevels(SDL_Joystick *joystick)
+{
+	struct joystick_hwdata *hwdata;
+	int envelope;
+	int level;
+	int i;
+
+	hwdata = joystick->hwdata;
+	envelope = hwdata->haptics_state[2];
+	for ( i=0; i<joystick->nactuators; ++i ) {
+		if ( joystick->actuators[i].range <= 1 ) {
+			/* An on/off motor, kept on down to half its threshold */
+			level = 0;
+			if ( (envelope >= hwdata->haptics.small_threshold) ||
+			     (hwdata->haptics_level[i] &&
+			      (envelope >= hwdata->haptics.small_threshold/2)) ) {
+				level = 65535;
+			}
+		} else {
+			level = (((envelope - hwdata->haptics.threshold) << 1) *
+			         hwdata->haptics.gain) >> 8;
+			if ( level < 0 ) {
+				level = 0;
+			} else if ( level > 65535 ) {
+				level = 65535;
 			}
+		}
+		hwdata->haptics_level[i] = level;
+	}
+}
 
-			joystick->hwdata->old_joystick_buttons = joystick_buttons;
+/*
+ * Drive the actuators of every joystick with haptics on from audio.
+ */
+void SDL_JoystickFeedAudio(const SDL_AudioSpec *spec, const Uint8 *stream, int len)
+{
+	SDL_Joystick *haptic[MAX_JOYSTICKS];
+	int nhaptic;
+	int samples;
+	int channels;
+	int sample;
+	int sum;
+	int frames;
+	int i, j;
+
+	nhaptic = 0;
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		if ( SDL_joyhaptics[i] ) {
+			haptic[nhaptic++] = SDL_joyhaptics[i];
+		}
+	}
+	if ( (nhaptic == 0) || (spec->channels == 0) || (spec->freq <= 0) ) {
+		return;
+	}
 
-			/* Only send axis events for joysticks that support analog controls! */
-			if((joystick->hwdata->joystick_type == PS2PAD_TYPE_DUALSHOCK) ||
-				(joystick->hwdata->joystick_type == PS2PAD_TYPE_DUALSHOCK))
-			{
-				/* Normalise joystick axes into within the -32767 -> +32767 range.
-				   
-				   The 2 analog sticks (2 axes each) are read in the same order as
-				   the Linux JS module. (left == 0,1, right == 2,3).
-				   
-				   If the axis value has not changed do not send the same value as
-				   though there has been a change.
-				   
-				   When the joystick is first updated by SDL_EventPoll() the
-				   old_joystick_buffer is all 0, this has the desired effect of new
-				   events for each axis and to be sent
-				*/
-
-				/* Do not send axis events when there is no change */
-				if(joystick_buffer[6] != joystick->hwdata->old_joystick_buffer[6])
-				{
-					SDL_PrivateJoystickAxis(joystick, 0, (joystick_buffer[6] << 8) - 32768);
-				}
+	/* The filters depend on the sample rate */
+	for ( j=0; j<nhaptic; ++j ) {
+		struct joystick_hwdata *hwdata = haptic[j]->hwdata;
 
-				/* Do not send axis events when there is no change */
-				if(joystick_buffer[7] != joystick->hwdata->old_joystick_buffer[7])
-				{
-					SDL_PrivateJoystickAxis(joystick, 1, (joystick_buffer[7] << 8) - 32768);
-				}
+		if ( hwdata->haptics_rate != spec->freq ) {
+			hwdata->haptics_rate = spec->freq;
+			hwdata->haptics_coef[0] = HapticsCoefficient(hwdata->haptics.high_hz, spec->freq);
+			hwdata->haptics_coef[1] = HapticsCoefficient(hwdata->haptics.low_hz, spec->freq);
+			hwdata->haptics_coef[2] = HapticsCoefficient(JOYHAPTIC_ATTACK_HZ, spec->freq);
+			hwdata->haptics_coef[3] = HapticsCoefficient(JOYHAPTIC_RELEASE_HZ, spec->freq);
+		}
+	}
 
-				/* Do not send axis events when there is no change */
-				if(joystick_buffer[4] != joystick->hwdata->old_joystick_buffer[4])
-				{
-					SDL_PrivateJoystickAxis(joystick, 2, (joystick_buffer[4] << 8) - 32768);
+	channels = spec->channels;
+	sum = SDL_joyhaptics_sum;
+	frames = SDL_joyhaptics_frames;
+	switch (spec->format) {
+	    case AUDIO_S16SYS:
+		samples = len / 2;
+		for ( i=0; i<samples; ) {
+			const Sint16 *pcm = (const Sint16 *)stream;
+
+			/* Four at a time while a whole frame of them is left */
+			if ( (channels == 2) && (i+3 < samples) ) {
+				sum += (pcm[i] + pcm[i+1] + pcm[i+2] + pcm[i+3]) >> 1;
+				i += 4;
+				frames += 2;
+			} else {
+				for ( j=0; j<channels; ++j ) {
+					sum += pcm[i++] / channels;
 				}
-
-				/* Do not send axis events when there is no change */
-				if(joystick_buffer[5] != joystick->hwdata->old_joystick_buffer[5])
-				{
-					SDL_PrivateJoystickAxis(joystick, 3, (joystick_buffer[5] << 8) - 32768);
+				++frames;
+			}
+			if ( frames >= JOYHAPTIC_BLOCK ) {
+				sample = sum / frames;
+				for ( j=0; j<nhaptic; ++j ) {
+					HapticsStep(haptic[j]->hwdata, sample);
 				}
+				sum = 0;
+				frames = 0;
 			}
-			
-			/* Store joystick_buffer for next itteration */
-			memcpy(&joystick->hwdata->old_joystick_buffer, &joystick_buffer, sizeof(joystick_buffer));
-
-			break;
-		}
-		case PS2PAD_STAT_NOTCON:
-		{
-			SDL_SetError("No device connected to %s\n",
-			     SDL_joylist[joystick->index]);
-			break;
 		}
-		case PS2PAD_STAT_BUSY:
-		{
-			SDL_SetError("Busy device connected to %s\n",
-			     SDL_joylist[joystick->index]);
-			break;
-		}
-		case PS2PAD_STAT_ERROR:
-		{
-			SDL_SetError("Error on device connected to %s\n",
-		             SDL_joylist[joystick->index]);
-			break;
-		}
-		default:
-		{
-			SDL_SetError("Unknown status on device connected to %s\n",
-		             SDL_joylist[joystick->index]);
-			break;
+		break;
+	    case AUDIO_U8:
+	    case AUDIO_S8:
+		/* Eight bit audio is taken up to the 16 bit range */
+		for ( i=0; i+channels <= len; ) {
+			for ( j=0; j<channels; ++j ) {
+				if ( spec->format == AUDIO_U8 ) {
+					sum += ((int)stream[i++] - 128) * 256 / channels;
+				} else {
+					sum += (int)(Sint8)stream[i++] * 256 / channels;
+				}
+			}
+			if ( ++frames >= JOYHAPTIC_BLOCK ) {
+				sample = sum / frames;
+				for ( j=0; j<nhaptic; ++j ) {
+					HapticsStep(haptic[j]->hwdata, sample);
+				}
+				sum = 0;
+				frames = 0;
+			}
 		}
+		break;
+	    default:
+		/* Other formats are not supported */
+		return;
 	}
+	SDL_joyhaptics_sum = sum;
+	SDL_joyhaptics_frames = frames;
 
+	for ( j=0; j<nhaptic; ++j ) {
+		HapticsLevels(haptic[j]);
+	}
 }
 
+/* Send the levels worked out from the audio to the pad, if it is time */
+static void HapticsUpdate(SDL_Joystick *joystick)
+{
+	Uint32 now;
+	int i;
+
+	now = SDL_GetTicks();
+	if ( (now - joystick->hwdata->haptics_time) < (Uint32)joystick->hwdata->haptics.interval_ms ) {
+		return;
+	}
+	joystick->hwdata->haptics_time = now;
+	for ( i=0; i<joystick->nactuators; ++i ) {
+		StoreActuator(joystick, i, joystick->hwdata->haptics_level[i]);
+	}
+	FlushActuators(joystick);
+}
 
-#ifdef USE_INPUT_EVENTS
-static __inline__ int EV_AxisCorrect(SDL_Joystick *joystick, int which, int value)
+/*
+ * Start or stop driving a joystick's actuators from audio.
+ */
+int SDL_JoystickSetAudioHaptics(SDL_Joystick *joystick,
+                                const SDL_JoystickAudioHaptics *haptics)
 {
-	struct axis_correct *correct;
+	struct joystick_hwdata *hwdata;
+	int i;
 
-	correct = &joystick->hwdata->abs_correct[which];
-	if ( correct->used ) {
-		if ( value > correct->coef[0] ) {
-			if ( value < correct->coef[1] ) {
-				return 0;
+	if ( (joystick == NULL) || (joystick->hwdata == NULL) ) {
+		SDL_SetError("Joystick hasn't been opened yet");
+		return(-1);
+	}
+	if ( haptics && ((joystick->nactuators == 0) || (joystick->actuators == NULL)) ) {
+		SDL_SetError("Joystick has no actuators");
+		return(-1);
+	}
+	/* The envelope is at most 65535, the limits keep the levels in an int */
+	if ( haptics && ((haptics->low_hz <= 0) || (haptics->high_hz <= haptics->low_hz) ||
+	                 (haptics->threshold < 0) || (haptics->threshold > 32767) ||
+	                 (haptics->small_threshold < 0) || (haptics->small_threshold > 32767) ||
+	                 (haptics->gain < 0) || (haptics->gain > JOYHAPTIC_MAX_GAIN) ||
+	                 (haptics->interval_ms < 0)) ) {
+		SDL_SetError("Invalid audio haptics");
+		return(-1);
+	}
+
+	/* The audio callback reads the settings */
+	hwdata = joystick->hwdata;
+	SDL_LockAudio();
+	if ( haptics ) {
+		if ( !hwdata->haptics_on ) {
+			memset(hwdata->haptics_state, 0, sizeof(hwdata->haptics_state));
+			for ( i=0; i<MAX_ACTUATORS; ++i ) {
+				hwdata->haptics_level[i] = 0;
 			}
-			value -= correct->coef[1];
-		} else {
-			value -= correct->coef[0];
 		}
-		value *= correct->coef[2];
-		value >>= 14;
+		hwdata->haptics = *haptics;
+		hwdata->haptics_rate = 0;
+		hwdata->haptics_on = SDL_TRUE;
+		SDL_joyhaptics[joystick->index] = joystick;
+	} else {
+		hwdata->haptics_on = SDL_FALSE;
+		SDL_joyhaptics[joystick->index] = NULL;
 	}
+	SDL_UnlockAudio();
 
-	/* Clamp and return */
-	if ( value < -32767 ) return -32767;
-	if ( value >  32767 ) return  32767;
+	if ( haptics == NULL ) {
+		for ( i=0; i<joystick->nactuators; ++i ) {
+			StoreActuator(joystick, i, 0);
+		}
+		FlushActuators(joystick);
+	}
+	return(0);
+}
 
-	return value;
+/*
+ * Post a frame event for every joystick report that changes something.
+ */
+int SDL_JoystickFrameEventState(int type)
+{
+	int previous;
+
+	previous = SDL_joyframe_type;
+	if ( type != SDL_QUERY ) {
+		if ( (type != 0) && ((type < SDL_USEREVENT) || (type >= SDL_NUMEVENTS)) ) {
+			SDL_SetError("Frame events need a user event type, not %d", type);
+			return(-1);
+		}
+		SDL_joyframe_type = type;
+	}
+	return(previous);
 }
 
-static __inline__ void EV_HandleEvents(SDL_Joystick *joystick)
+/*
+ * Call a function with every frame of a joystick that changes something,
+ * as soon as the report has been decoded.
+ */
+int SDL_JoystickSetFrameCallback(SDL_Joystick *joystick,
+                                 SDL_JoystickFrameCallback callback,
+                                 void *userdata)
 {
-	struct input_event events[32];
-	int i, len;
-	int code;
+	if ( (joystick == NULL) || (joystick->hwdata == NULL) ) {
+		SDL_SetError("Joystick hasn't been opened yet");
+		return(-1);
+	}
+	joystick->hwdata->frame_callback = NULL;
+	joystick->hwdata->frame_userdata = userdata;
+	joystick->hwdata->frame_callback = callback;
+	return(0);
+}
 
-	while ((len=read(joystick->hwdata->fd, events, (sizeof events))) > 0) {
-		len /= sizeof(events[0]);
-		for ( i=0; i<len; ++i ) {
-			code = events[i].code;
-			switch (events[i].type) {
-			    case EV_KEY:
-				if ( code >= BTN_MISC ) {
-					code -= BTN_MISC;
-					SDL_PrivateJoystickButton(joystick,
-				           joystick->hwdata->key_map[code],
-					   events[i].value);
-				}
-				break;
-			    case EV_ABS:
-				switch (code) {
-				    case ABS_HAT0X:
-				    case ABS_HAT0Y:
-				    case ABS_HAT1X:
-				    case ABS_HAT1Y:
-				    case ABS_HAT2X:
-				    case ABS_HAT2Y:
-				    case ABS_HAT3X:
-				    case ABS_HAT3Y:
-					code -= ABS_HAT0X;
-					HandleHat(joystick, code/2, code%2,
-							events[i].value);
-					break;
-				    default:
-					events[i].value = EV_AxisCorrect(joystick, code, events[i].value);
-					SDL_PrivateJoystickAxis(joystick,
-				           joystick->hwdata->abs_map[code],
-					   events[i].value);
-					break;
-				}
-				break;
-			    case EV_REL:
-				switch (code) {
-				    case REL_X:
-				    case REL_Y:
-					code -= REL_X;
-					HandleBall(joystick, code/2, code%2,
-							events[i].value);
-					break;
-				    default:
-					break;
-				}
-				break;
-			    default:
-				break;
+/*
+ * Get the measured skew between the pads read in each sampling round.
+ */
+void SDL_JoystickGetSamplingStats(SDL_JoystickSamplingStats *stats)
+{
+	*stats = SDL_joysampling.stats;
+}
+
+/*
+ * Get the usage totals of a joystick, and optionally start them again.
+ */
+int SDL_JoystickGetAnalytics(SDL_Joystick *joystick,
+                             SDL_JoystickAnalytics *analytics, int reset)
+{
+	struct joystick_hwdata *hwdata;
+	Uint32 now;
+	int i;
+
+	if ( (joystick == NULL) || (joystick->hwdata == NULL) ) {
+		SDL_SetError("Joystick hasn't been opened yet");
+		return(-1);
+	}
+	hwdata = joystick->hwdata;
+	if ( analytics ) {
+		*analytics = hwdata->analytics;
+	}
+
+	/* Include the time of the actuators still running */
+	now = SDL_GetTicks();
+	for ( i=0; (i < joystick->nactuators) && (i < SDL_JOYSTATS_ACTUATORS); ++i ) {
+		if ( joystick->actuators && joystick->actuators[i].normalised ) {
+			if ( analytics ) {
+				analytics->actuator_ms[i] += now - hwdata->actuator_on_time[i];
+			}
+			if ( reset ) {
+				hwdata->actuator_on_time[i] = now;
 			}
 		}
 	}
+	if ( reset ) {
+		memset(&hwdata->analytics, 0, sizeof(hwdata->analytics));
+	}
+	return(0);
 }
-#endif /* USE_INPUT_EVENTS */
 
-void SDL_SYS_JoystickUpdate(SDL_Joystick *joystick)
+/*
+ * Put the jitter filter on the axes of a joystick, or take it off.
+ */
+int SDL_JoystickSetAxisFilter(SDL_Joystick *joystick,
+                              const SDL_JoystickAxisFilter *filter)
 {
+	struct joystick_hwdata *hwdata;
 	int i;
 
-#ifdef USE_INPUT_EVENTS
-	if ( joystick->hwdata->is_hid )
-		EV_HandleEvents(joystick);
-	else
-#endif
-		JS_HandleEvents(joystick);
+	if ( (joystick == NULL) || (joystick->hwdata == NULL) ) {
+		SDL_SetError("Joystick hasn't been opened yet");
+		return(-1);
+	}
+	if ( (SDL_joylist[joystick->index].kind == JOYKIND_SHM) ||
+	     (SDL_joylist[joystick->index].kind == JOYKIND_STREAM) ) {
+		SDL_SetError("Joystick %d comes from another process, filter it there",
+		             joystick->index);
+		return(-1);
+	}
+	if ( joystick->hwdata->gun ) {
+		SDL_SetError("Light gun positions aren't filtered");
+		return(-1);
+	}
+	if ( filter && ((filter->min_cutoff <= 0.0f) || (filter->beta < 0.0f) ||
+	                (filter->hysteresis < 0)) ) {
+		SDL_SetError("Invalid axis filter");
+		return(-1);
+	}
 
-	/* Deliver ball motion updates */
-	for ( i=0; i<joystick->nballs; ++i ) {
-		int xrel, yrel;
+	hwdata = joystick->hwdata;
+	if ( filter == NULL ) {
+		if ( hwdata->filter_on ) {
+			hwdata->filter_on = SDL_FALSE;
+			hwdata->filter_unsettled = 0;
+			if ( hwdata->decode_unfiltered ) {
+				hwdata->decode = hwdata->decode_unfiltered;
+				/* Send the raw position of every axis on the next update */
+				for ( i=0; i<joystick->naxes; ++i ) {
+					hwdata->old_joystick_buffer[hwdata->axis_offset[i]] ^= 0xFF;
+				}
+			}
+		}
+		return(0);
+	}
 
-		xrel = joystick->hwdata->balls[i].axis[0];
-		yrel = joystick->hwdata->balls[i].axis[1];
-		if ( xrel || yrel ) {
-			joystick->hwdata->balls[i].axis[0] = 0;
-			joystick->hwdata->balls[i].axis[1] = 0;
-			SDL_PrivateJoystickBall(joystick, (Uint8)i, xrel, yrel);
+	hwdata->filter_params = *filter;
+	if ( !hwdata->filter_on ) {
+		memset(hwdata->filter, 0, sizeof(hwdata->filter));
+		hwdata->filter_unsettled = 0;
+		hwdata->filter_on = SDL_TRUE;
+		/* Event devices have no decode routine, the filter is applied as
+		   their events are read */
+		if ( hwdata->decode ) {
+			hwdata->decode_unfiltered = hwdata->decode;
+			hwdata->decode = JS_DecodeFiltered;
 		}
 	}
+	return(0);
 }
 
 /*
- * Set an actuator value of a joystick
- * The actuator indices start at index 0.
-   On the PS2 DualShock 1/2:
-	actuator 0 (small) has a boolean frequency
-	actuator 1 (big) has 0-255 range
-   Both of these are normalised to within the 0-65535 SDL range
+ * Get how many axis changes the jitter filter has held back.
  */
-int SDL_SYS_JoystickSetActuator(SDL_Joystick *joystick, int actuator, int frequency)
+int SDL_JoystickGetAxisFilterStats(SDL_Joystick *joystick,
+                                   SDL_JoystickAxisFilterStats *stats)
 {
-	struct ps2pad_act actuator_buffer;
-	int normalised_frequency;
-
-	normalised_frequency = 0;
+	if ( (joystick == NULL) || (joystick->hwdata == NULL) ) {
+		SDL_SetError("Joystick hasn't been opened yet");
+		return(-1);
+	}
+	*stats = joystick->hwdata->filter_stats;
+	stats->suppressed = 0;
+	if ( stats->changes > stats->delivered ) {
+		stats->suppressed = stats->changes - stats->delivered;
+	}
+	return(0);
+}
 
-	(joystick->actuators + actuator)->frequency = frequency;
+/*
+ * Stream the frames of every open joystick to a file descriptor.
+ */
+int SDL_JoystickExportStream(int fd)
+{
+	char where[32];
+	int i;
 
-	actuator_buffer.len = 6;
-	switch(actuator)
-	{
-		case 0:
-		{
-			normalised_frequency = (frequency > 1);
-			joystick->actuators[0].normalised = normalised_frequency;
-			actuator_buffer.data[0] = normalised_frequency;
-			actuator_buffer.data[1] = joystick->actuators[1].normalised;
-			break;
-		}
-		case 1:
-		{
-			/* Normalise to within PS2 Actuator range for actuator 1 */
-			normalised_frequency = frequency >> 8;
-			joystick->actuators[1].normalised = normalised_frequency;
-			actuator_buffer.data[1] = normalised_frequency;
-			actuator_buffer.data[0] = joystick->actuators[0].normalised;
-			break;
-		}
-		default:
-		{
-			SDL_SetError("Unknown actuator: %d\n", actuator);
-			return 1;
+	if ( (SDL_joystream.fd >= 0) || (SDL_joystream.listen_fd >= 0) ) {
+		if ( !SDL_joystream.export ) {
+			SDL_SetError("Joysticks are being read from a stream");
+			return(-1);
 		}
+		STREAM_Flush();
+		STREAM_Close();
+	}
+	if ( fd < 0 ) {
+		return(0);
 	}
 
-	/* printf("\tSDL_SYS_JoystickSetActuator act: %d freq: %d\n", actuator, frequency); */
-	ioctl(joystick->hwdata->fd, PS2PAD_IOCSETACT, &actuator_buffer);
-	return 0;
+	sprintf(where, "fd:%d", fd);
+	if ( STREAM_Open(where, SDL_TRUE) < 0 ) {
+		return(-1);
+	}
+	for ( i=0; i<MAX_JOYSTICKS; ++i ) {
+		if ( SDL_joyopen[i] ) {
+			STREAM_ExportPad(SDL_joyopen[i], SDL_TRUE);
+		}
+	}
+	return(0);
 }
 
+/*
+ * Get the amount of data streamed so far.
+ */
+void SDL_JoystickGetStreamStats(SDL_JoystickStreamStats *stats)
+{
+	*stats = SDL_joystream.stats;
+}
 
 /* Function to close a joystick after use */
 void SDL_SYS_JoystickClose(SDL_Joystick *joystick)
 {
 	int loop;
 
-	/* If joystick has actuators ensure they are off */
-	for(loop = 0; loop < joystick->nactuators; loop++) {
-		SDL_JoystickSetActuator(joystick, loop, 0);
-	}
-
 	if ( joystick->hwdata ) {
-		close(joystick->hwdata->fd);
+		/* Stop the audio callback using it */
+		if ( joystick->hwdata->haptics_on ) {
+			SDL_LockAudio();
+			joystick->hwdata->haptics_on = SDL_FALSE;
+			SDL_joyhaptics[joystick->index] = NULL;
+			SDL_UnlockAudio();
+		}
+
+		/* If joystick has actuators ensure they are off */
+		if ( joystick->actuators ) {
+			for(loop = 0; loop < joystick->nactuators; loop++) {
+				StoreActuator(joystick, loop, 0);
+			}
+			FlushActuators(joystick);
+		}
+#ifdef USE_INPUT_EVENTS
+		if ( joystick->hwdata->is_hid && (joystick->hwdata->ff_effect.id >= 0) ) {
+			ioctl(joystick->hwdata->fd, EVIOCRMFF, joystick->hwdata->ff_effect.id);
+		}
+#endif
+
+		if ( SDL_joyshm_owner ) {
+			SHM_PublishPad(joystick, SDL_FALSE);
+		}
+		if ( SDL_joystream.export ) {
+			STREAM_ExportPad(joystick, SDL_FALSE);
+			STREAM_Flush();
+		}
+		if ( joystick->hwdata->fd >= 0 ) {
+			close(joystick->hwdata->fd);
+		}
+		SDL_joyopen[joystick->index] = NULL;
 		if ( joystick->hwdata->hats ) {
 			free(joystick->hwdata->hats);
 		}
@@ -1012,11 +4311,26 @@ void SDL_SYS_JoystickClose(SDL_Joystick *joystick)
 void SDL_SYS_JoystickQuit(void)
 {
 	int i;
-	for ( i=0; (SDL_joylist[i] && i < MAX_JOYSTICKS); ++i ) {
-		free(SDL_joylist[i]);
-		SDL_joylist[i] = NULL;
+	for ( i=0; (i < MAX_JOYSTICKS) && SDL_joylist[i].path; ++i ) {
+		free(SDL_joylist[i].path);
+		SDL_joylist[i].path = NULL;
 	}
 
-	SDL_joylist[0] = NULL;
+	if ( ps2padstat_fd >= 0 ) {
+		close(ps2padstat_fd);
+		ps2padstat_fd = -1;
+	}
+	SHM_Detach();
+	if ( SDL_joystream.export ) {
+		STREAM_Flush();
+	}
+	STREAM_Close();
+	memset(SDL_joystream.pads, 0, sizeof(SDL_joystream.pads));
+	if ( SDL_joycache ) {
+		free(SDL_joycache);
+		SDL_joycache = NULL;
+	}
+	SDL_joycache_len = 0;
+	SDL_joycache_dirty = SDL_FALSE;
 }
 